@@ -0,0 +1,137 @@
+#ifndef CONCURRENCY_CHANNEL_H
+#define CONCURRENCY_CHANNEL_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Typed multi-message channel: several message types over one SPSCQueue or SPMCQueue
+ * - MsgSlot<SlotSize, Ts...> is the queue's T: a type tag followed by the payload of one of Ts, written in place
+ * - the tag is 1 + the index of the type in Ts, so both sides only need to agree on the list (and its order), and
+ *   a zero-filled slot (a fresh shmMap) has tag 0: empty
+ * - visit() dispatches through a jump table generated at compile time, one direct call per message, no virtual
+ *   calls and no hand-written switch
+ * - every type must be trivially copyable and fit the slot, checked at compile time; the slot itself stays
+ *   trivially copyable, so the queue can live in shmMap and SPMCQueue::Reader::copy() works on it
+ * SlotSize is the whole slot, tag included: pick the largest type plus 8 bytes (or a cache line) so that the small
+ * messages don't pay for a rare large one, which should go through SPSCVarQueue instead.
+ *
+ * using Msgs = MsgSlot<64, NewOrder, Cancel, Trade>;
+ * SPSCQueue<Msgs, 1024> queue;
+ * pushMsg<Cancel>(queue, [](Cancel& c) { c.id_ = 42; });
+ * queue.tryPop([](Msgs* m) { m->visit(Overloaded{[](NewOrder& o) {...}, [](Cancel& c) {...}, [](Trade& t) {...}}); });
+ */
+
+// builds a visitor out of lambdas, one per message type
+template<typename... Fs>
+struct Overloaded : Fs... {
+    using Fs::operator()...;
+};
+
+template<typename... Fs>
+Overloaded(Fs...) -> Overloaded<Fs...>;
+
+template<typename T, typename... Ts>
+inline constexpr std::size_t msg_index_v = 0;
+
+template<typename T, typename U, typename... Ts>
+inline constexpr std::size_t msg_index_v<T, U, Ts...> = std::is_same_v<T, U> ? 0 : 1 + msg_index_v<T, Ts...>;
+
+template<typename T, typename... Ts>
+inline constexpr std::size_t msg_count_v = (std::size_t{std::is_same_v<T, Ts>} + ... + 0);
+
+template<std::size_t SlotSize, typename... Ts>
+struct MsgSlot {
+    static_assert(sizeof...(Ts) > 0 && sizeof...(Ts) < 0xffff, "between 1 and 65534 message types");
+    static_assert((std::is_trivially_copyable_v<Ts> && ...), "message types must be trivially copyable");
+    static_assert(((msg_count_v<Ts, Ts...> == 1) && ...), "message types must be distinct");
+
+    using Tag = std::uint16_t;
+    static constexpr Tag NONE = 0;  // a slot that has never been written, constructed or zero-filled
+    static constexpr std::size_t ALIGN = std::max({alignof(Tag), alignof(Ts)...});
+    // the payload starts right after the tag, at the strictest alignment of the types
+    static constexpr std::size_t OFFSET = (sizeof(Tag) + ALIGN - 1) / ALIGN * ALIGN;
+    static constexpr std::size_t CAPACITY = SlotSize > OFFSET ? SlotSize - OFFSET : 0;
+    static_assert(((sizeof(Ts) <= CAPACITY) && ...), "a message type does not fit the slot");
+
+    template<typename T>
+    static constexpr bool holds_v = (std::is_same_v<T, Ts> || ...);
+
+    template<typename T>
+    static constexpr Tag tag_v = static_cast<Tag>(msg_index_v<T, Ts...> + 1);
+
+    alignas(ALIGN) Tag type_{NONE};
+    alignas(ALIGN) unsigned char data_[CAPACITY];
+
+    // sets the tag and returns the payload to fill in place, default-initialized (not zeroed)
+    template<typename T>
+    T& init() {
+        static_assert(holds_v<T>, "not one of the channel's message types");
+        type_ = tag_v<T>;
+        return *::new (static_cast<void*>(data_)) T;
+    }
+
+    template<typename T>
+    void set(const T& msg) {
+        init<T>() = msg;
+    }
+
+    [[nodiscard]] Tag type() const { return type_; }
+
+    template<typename T>
+    [[nodiscard]] bool is() const {
+        return type_ == tag_v<T>;
+    }
+
+    // the payload as T, the caller has checked is<T>()
+    template<typename T>
+    T& as() {
+        static_assert(holds_v<T>, "not one of the channel's message types");
+        return *std::launder(reinterpret_cast<T*>(data_));
+    }
+
+    template<typename T>
+    const T& as() const {
+        static_assert(holds_v<T>, "not one of the channel's message types");
+        return *std::launder(reinterpret_cast<const T*>(data_));
+    }
+
+    /**
+     * Calls visitor(T&) for the type the slot holds, the visitor must accept every type.
+     * Returns false for an empty slot or an unknown tag (a sender built with a longer type list).
+     */
+    template<typename Visitor>
+    bool visit(Visitor&& visitor) {
+        using V = std::remove_reference_t<Visitor>;
+        static_assert((std::is_invocable_v<V&, Ts&> && ...), "the visitor must handle every message type");
+        using Fn = void (*)(MsgSlot&, V&);
+        static constexpr std::array<Fn, sizeof...(Ts)> table{[](MsgSlot& slot, V& v) { v(slot.as<Ts>()); }...};
+        if (__builtin_expect(type_ == NONE || type_ > sizeof...(Ts), 0)) return false;
+        table[type_ - 1](*this, visitor);
+        return true;
+    }
+};
+
+// SPSCQueue<MsgSlot<...>>: writer(T&) fills the message in place
+template<typename T, typename Queue, typename Writer>
+bool tryPushMsg(Queue& queue, Writer writer) {
+    return queue.tryPush([&writer](auto* slot) { writer(slot->template init<T>()); });
+}
+
+template<typename T, typename Queue, typename Writer>
+void pushMsg(Queue& queue, Writer writer) {
+    queue.blockPush([&writer](auto* slot) { writer(slot->template init<T>()); });
+}
+
+// SPMCQueue<MsgSlot<...>>
+template<typename T, typename Queue, typename Writer>
+void writeMsg(Queue& queue, Writer writer) {
+    queue.write([&writer](auto& slot) { writer(slot.template init<T>()); });
+}
+
+#endif //CONCURRENCY_CHANNEL_H
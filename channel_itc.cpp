@@ -0,0 +1,253 @@
+#include "channel.h"
+#include "spmc.h"
+#include "spsc.h"
+#include "topology.h"
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+/**
+ * Three order messages of different sizes over one channel, MsgSlot<48, NewOrder, Cancel, Trade>
+ *   spsc: SPSCQueue, one consumer
+ *   spmc: SPMCQueue, two readers (read() in place and copy() out)
+ * The producer sends new, new, cancel, trade, ... and the consumers dispatch with visit(), count every type and
+ * check the fields. thread mode runs the consumers as threads, shm mode puts the queue in shmMap and forks them.
+ * usage: channel_itc [msgs] [thread|shm]
+ */
+
+struct NewOrder {
+    std::uint64_t tsc_;
+    std::uint64_t id_;
+    double price_;
+    std::uint32_t qty_;
+    char side_;
+    char symbol_[11];
+};
+
+struct Cancel {
+    std::uint64_t tsc_;
+    std::uint64_t id_;
+};
+
+struct Trade {
+    std::uint64_t tsc_;
+    std::uint64_t id_;
+    double price_;
+    std::uint32_t qty_;
+};
+
+using OrderMsg = MsgSlot<48, NewOrder, Cancel, Trade>;
+static_assert(sizeof(OrderMsg) == 48);
+
+using OrderSPSC = SPSCQueue<OrderMsg, 1024>;
+using OrderSPMC = SPMCQueue<OrderMsg, 1024>;
+
+constexpr int READERS = 2;
+
+// per consumer, in shmMap in shm mode so that the forked consumers can report back
+struct Stats {
+    std::uint64_t counts_[3];
+    std::uint64_t bad_;
+    std::uint64_t dropped_;
+    LatencyHistogram lat_;
+};
+
+struct Shared {
+    std::atomic<int> ready_;
+    Stats stats_[READERS];
+};
+
+void send(std::uint64_t i, auto&& push) {
+    switch (i % 4) {
+        case 0:
+        case 1:
+            push(std::type_identity<NewOrder>{}, [i](NewOrder& o) {
+                o.id_ = i;
+                o.price_ = 100.0 + static_cast<double>(i % 100);
+                o.qty_ = static_cast<std::uint32_t>(i % 1000);
+                o.side_ = i % 2 ? 'S' : 'B';
+                std::memcpy(o.symbol_, "ESZ4", 5);
+                o.tsc_ = rdtscp();
+            });
+            break;
+        case 2:
+            push(std::type_identity<Cancel>{}, [i](Cancel& c) {
+                c.id_ = i - 2;
+                c.tsc_ = rdtscp();
+            });
+            break;
+        default:
+            push(std::type_identity<Trade>{}, [i](Trade& t) {
+                t.id_ = i - 3;
+                t.price_ = 100.0 + static_cast<double>((i - 3) % 100);
+                t.qty_ = static_cast<std::uint32_t>((i - 3) % 1000);
+                t.tsc_ = rdtscp();
+            });
+            break;
+    }
+}
+
+// visitor checking every message against what send() wrote for its sequence number
+auto checker(Stats& stats, std::uint64_t& i) {
+    return Overloaded{
+            [&](NewOrder& o) {
+                stats.lat_.record(rdtscp() - o.tsc_);
+                ++stats.counts_[0];
+                stats.bad_ += o.id_ != i || o.qty_ != i % 1000 || std::strcmp(o.symbol_, "ESZ4") != 0;
+            },
+            [&](Cancel& c) {
+                stats.lat_.record(rdtscp() - c.tsc_);
+                ++stats.counts_[1];
+                stats.bad_ += c.id_ != i - 2;
+            },
+            [&](Trade& t) {
+                stats.lat_.record(rdtscp() - t.tsc_);
+                ++stats.counts_[2];
+                stats.bad_ += t.id_ != i - 3 || t.qty_ != (i - 3) % 1000;
+            },
+    };
+}
+
+template<typename Q>
+Q* makeQueue(bool shm, const char* name) {
+    if (shm) {
+        shm_unlink(name);
+        return shmMap<Q>(name);
+    }
+    return new Q();
+}
+
+template<typename Q>
+void freeQueue(bool shm, const char* name, Q* queue) {
+    if (shm) {
+        munmap(queue, sizeof(Q));
+        shm_unlink(name);
+    } else {
+        delete queue;
+    }
+}
+
+// runs consumer(i) as a thread or a forked process, then the producer, and waits for the consumers
+template<typename Consumer, typename Producer>
+void runRoles(bool shm, int consumers, Consumer consumer, Producer producer) {
+    std::vector<std::jthread> threads;
+    std::vector<pid_t> children;
+    for (int i = 0; i < consumers; ++i) {
+        if (shm) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                pinRole(i + 1, READERS + 1);
+                consumer(i);
+                _exit(0);
+            }
+            children.push_back(pid);
+        } else {
+            threads.emplace_back([&consumer, i] {
+                pinRole(i + 1, READERS + 1);
+                consumer(i);
+            });
+        }
+    }
+    pinRole(0, READERS + 1);
+    producer();
+    threads.clear();
+    for (auto pid: children) {
+        waitpid(pid, nullptr, 0);
+    }
+}
+
+void report(const char* name, const Stats& stats) {
+    std::cout << name << " new: " << stats.counts_[0] << " cancel: " << stats.counts_[1]
+              << " trade: " << stats.counts_[2] << " bad: " << stats.bad_ << " dropped: " << stats.dropped_ << "\n";
+    stats.lat_.print(std::cout, "  latency");
+}
+
+void runSpsc(bool shm, std::uint64_t msgs, Shared& shared) {
+    auto* queue = makeQueue<OrderSPSC>(shm, "channel_itc");
+    runRoles(
+            shm, 1,
+            [&](int) {
+                auto& stats = shared.stats_[0];
+                std::uint64_t i = 0;
+                auto visitor = checker(stats, i);
+                for (; i < msgs; ++i) {
+                    stats.bad_ += !queue->waitFront()->visit(visitor);
+                    queue->pop();
+                }
+            },
+            [&] {
+                for (std::uint64_t i = 0; i < msgs; ++i) {
+                    send(i, [queue]<typename T>(std::type_identity<T>, auto writer) { pushMsg<T>(*queue, writer); });
+                }
+            });
+    report(shm ? "spsc shm   " : "spsc thread", shared.stats_[0]);
+    freeQueue(shm, "channel_itc", queue);
+}
+
+void runSpmc(bool shm, std::uint64_t msgs, Shared& shared) {
+    auto* queue = makeQueue<OrderSPMC>(shm, "channel_itc");
+    runRoles(
+            shm, READERS,
+            [&](int r) {
+                auto& stats = shared.stats_[r];
+                auto reader = queue->getReader(OrderSPMC::JoinFrom::Oldest);
+                shared.ready_.fetch_add(1);
+                std::uint64_t i = 0;
+                auto visitor = checker(stats, i);
+                OrderMsg out;
+                while (true) {
+                    OrderMsg* msg = nullptr;
+                    if (r == 0) {
+                        msg = reader.read();
+                    } else if (reader.copy(out).status == OrderSPMC::ReadStatus::Ok) {
+                        msg = &out;
+                    }
+                    if (!msg) {
+                        if (reader.lastSeq() >= msgs) break;
+                        cpuRelax();
+                        continue;
+                    }
+                    // sequence numbers start at 1
+                    i = reader.lastSeq() - 1;
+                    stats.bad_ += !msg->visit(visitor);
+                }
+                stats.dropped_ = reader.dropped_;
+            },
+            [&] {
+                while (shared.ready_.load() != READERS) {
+                    std::this_thread::yield();
+                }
+                for (std::uint64_t i = 0; i < msgs; ++i) {
+                    send(i, [queue]<typename T>(std::type_identity<T>, auto writer) { writeMsg<T>(*queue, writer); });
+                }
+            });
+    report(shm ? "spmc shm    read" : "spmc thread read", shared.stats_[0]);
+    report(shm ? "spmc shm    copy" : "spmc thread copy", shared.stats_[1]);
+    freeQueue(shm, "channel_itc", queue);
+}
+
+int main(int argc, char** argv) {
+    const std::uint64_t msgs = argc > 1 ? std::stoull(argv[1]) : 1'000'000;
+    const bool shm = argc > 2 && std::string(argv[2]) == "shm";
+    tscCalibration();
+    placeCpus(READERS + 1);
+
+    for (auto run: {runSpsc, runSpmc}) {
+        if (shm) shm_unlink("channel_itc_stats");  // start from a zero-filled segment
+        auto* shared = shm ? shmMap<Shared>("channel_itc_stats") : new Shared();
+        run(shm, msgs, *shared);
+        if (shm) {
+            munmap(shared, sizeof(Shared));
+            shm_unlink("channel_itc_stats");
+        } else {
+            delete shared;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include "spsc.h"
+#include "topology.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+/**
+ * Core-to-core latency matrix
+ * Ping-pong between every pair of cpus over two SPSCQueues, the one-way latency is half of the round trip.
+ * Prints the median and p99 one-way latency matrices in ns, then a summary per topology relation (see topology.h)
+ * with the best pair of each, to pick the cores of a producer/consumer pair on a new machine.
+ * usage: core_latency [round_trips] [cpus, e.g. 0-7,16]
+ */
+
+struct Ping {
+    std::uint64_t seq_;
+};
+
+using PingQueue = SPSCQueue<Ping, 64>;
+
+constexpr std::uint64_t WARMUP = 1'000;
+
+struct PairResult {
+    int a;
+    int b;
+    double p50;
+    double p99;
+};
+
+LatencyHistogram measure(int a, int b, std::uint64_t round_trips) {
+    auto ping = std::make_unique<PingQueue>();
+    auto pong = std::make_unique<PingQueue>();
+    LatencyHistogram lat;
+    {
+        std::jthread echo([&] {
+            pinCpu(b);
+            for (std::uint64_t i = 0; i < WARMUP + round_trips; ++i) {
+                const auto seq = ping->waitFront()->seq_;
+                ping->pop();
+                pong->blockPush([seq](Ping* p) { p->seq_ = seq; });
+            }
+        });
+        std::jthread initiator([&] {
+            pinCpu(a);
+            for (std::uint64_t i = 0; i < WARMUP + round_trips; ++i) {
+                const auto start = rdtscp();
+                ping->blockPush([i](Ping* p) { p->seq_ = i; });
+                pong->waitFront();
+                pong->pop();
+                const auto rtt = rdtscp() - start;
+                if (i >= WARMUP) lat.record(rtt / 2);
+            }
+        });
+    }
+    return lat;
+}
+
+void printMatrix(const char* title, const std::vector<int>& cpus, const std::vector<std::vector<double>>& ns) {
+    std::cout << title << "\n" << std::setw(8) << "cpu";
+    for (int cpu: cpus) std::cout << std::setw(8) << cpu;
+    std::cout << "\n";
+    for (std::size_t i = 0; i < cpus.size(); ++i) {
+        std::cout << std::setw(8) << cpus[i];
+        for (std::size_t j = 0; j < cpus.size(); ++j) {
+            if (i == j) {
+                std::cout << std::setw(8) << "-";
+            } else {
+                std::cout << std::setw(8) << static_cast<std::uint64_t>(ns[i][j]);
+            }
+        }
+        std::cout << "\n";
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+    const std::uint64_t round_trips = argc > 1 ? std::stoull(argv[1]) : 10'000;
+    const auto& topo = topology();
+    const auto& tsc = tscCalibration();
+
+    std::map<int, CpuInfo> info;
+    for (auto& c: topo.cpus_) info[c.cpu_] = c;
+    std::vector<int> cpus;
+    if (argc > 2) {
+        for (int cpu: parseCpuList(argv[2])) {
+            if (info.count(cpu)) {
+                cpus.push_back(cpu);
+            } else {
+                std::cerr << "cpu " << cpu << " is offline or not in our affinity mask, skipped" << std::endl;
+            }
+        }
+    } else {
+        for (auto& [cpu, c]: info) cpus.push_back(cpu);
+    }
+    if (cpus.size() < 2) {
+        std::cerr << "need at least 2 cpus" << std::endl;
+        return 1;
+    }
+
+    for (int cpu: cpus) std::cout << info[cpu] << "\n";
+    std::cout << std::endl;
+
+    const auto n = cpus.size();
+    std::vector<std::vector<double>> p50(n, std::vector<double>(n));
+    std::vector<std::vector<double>> p99(n, std::vector<double>(n));
+    std::map<CpuRelation, std::vector<PairResult>> by_relation;
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t j = i + 1; j < n; ++j) {
+            const auto lat = measure(cpus[i], cpus[j], round_trips);
+            p50[i][j] = p50[j][i] = static_cast<double>(lat.percentile(0.5)) * tsc.ns_per_cycle;
+            p99[i][j] = p99[j][i] = static_cast<double>(lat.percentile(0.99)) * tsc.ns_per_cycle;
+            by_relation[relation(info[cpus[i]], info[cpus[j]])].push_back({cpus[i], cpus[j], p50[i][j], p99[i][j]});
+        }
+    }
+
+    printMatrix("one-way p50 (ns)", cpus, p50);
+    printMatrix("one-way p99 (ns)", cpus, p99);
+
+    std::cout << std::left << std::setw(14) << "relation" << std::right << std::setw(7) << "pairs" << std::setw(9)
+              << "p50 min" << std::setw(9) << "p50 avg" << std::setw(9) << "p50 max" << std::setw(9) << "p99 avg"
+              << "  best pair\n";
+    for (auto& [rel, results]: by_relation) {
+        double sum50 = 0;
+        double sum99 = 0;
+        auto best = results.front();
+        double max50 = 0;
+        for (auto& r: results) {
+            sum50 += r.p50;
+            sum99 += r.p99;
+            max50 = std::max(max50, r.p50);
+            if (r.p50 < best.p50) best = r;
+        }
+        const auto cnt = static_cast<double>(results.size());
+        std::cout << std::left << std::setw(14) << relationName(rel) << std::right << std::setw(7) << results.size()
+                  << std::setw(9) << static_cast<std::uint64_t>(best.p50) << std::setw(9)
+                  << static_cast<std::uint64_t>(sum50 / cnt) << std::setw(9) << static_cast<std::uint64_t>(max50)
+                  << std::setw(9) << static_cast<std::uint64_t>(sum99 / cnt) << "  " << best.a << "-" << best.b << "\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,215 @@
+#ifndef CONCURRENCY_EVENT_LOOP_H
+#define CONCURRENCY_EVENT_LOOP_H
+
+#include "utils.h"
+#include "wait_strategy.h"
+
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <utility>
+
+/**
+ * Single-thread event loop for coroutines waiting on many queues
+ * - co_await loop.front(spsc_queue) and co_await loop.read(spmc_reader) mirror waitFront() and waitRead(): they
+ *   return the message in place, the coroutine calls queue.pop() itself for SPSCQueue
+ * - if a message is there, await_ready() returns it without suspending, so a coroutine drains its queue in a tight
+ *   batch; after BATCH messages in a row it suspends anyway and goes to the back of the line, so that a busy queue
+ *   doesn't starve the others
+ * - a suspended coroutine is parked on an intrusive list: the waiter lives in the awaiter, i.e. in the coroutine
+ *   frame, no allocation per await (one for the frame when the coroutine is spawned)
+ * - run() sweeps the parked coroutines in order, polls each once and resumes the ones whose queue has data,
+ *   it never blocks: pin the thread to a core of its own (pinRole() in topology.h) and let it spin
+ * Everything runs on the loop's thread, only the queues are shared with other threads or processes.
+ */
+
+struct EventLoop {
+    static constexpr std::uint32_t BATCH = 64;  // messages a coroutine may take before it yields to the others
+
+    struct Waiter {
+        bool (*poll_)(Waiter*){nullptr};  // fetches the message, true when the coroutine can be resumed
+        std::coroutine_handle<> handle_;
+        Waiter* next_{nullptr};
+    };
+
+    // a coroutine run by the loop, started by spawn(), its frame is freed when it returns (or with the Task if it
+    // is never spawned)
+    struct Task {
+        struct promise_type {
+            EventLoop* loop_{nullptr};
+            Waiter start_;  // parked by spawn() until the first sweep
+
+            Task get_return_object() { return Task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() { --loop_->live_; }
+            void unhandled_exception() { std::terminate(); }
+        };
+
+        std::coroutine_handle<promise_type> handle_;
+
+        explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+        Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+        ~Task() {
+            if (handle_) handle_.destroy();
+        }
+    };
+
+    template<typename Queue>
+    struct FrontAwaiter : Waiter {
+        EventLoop& loop_;
+        Queue& queue_;
+        decltype(std::declval<Queue&>().front()) msg_{nullptr};
+
+        FrontAwaiter(EventLoop& loop, Queue& queue) : loop_(loop), queue_(queue) {}
+
+        bool await_ready() {
+            if (loop_.budget_ && (msg_ = queue_.front())) {
+                --loop_.budget_;
+                return true;
+            }
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            poll_ = &poll;
+            handle_ = handle;
+            loop_.park(this);
+        }
+
+        auto await_resume() { return msg_; }
+
+        static bool poll(Waiter* waiter) {
+            auto* self = static_cast<FrontAwaiter*>(waiter);
+            return (self->msg_ = self->queue_.front()) != nullptr;
+        }
+    };
+
+    template<typename Reader>
+    struct ReadAwaiter : Waiter {
+        EventLoop& loop_;
+        Reader& reader_;
+        decltype(std::declval<Reader&>().read()) msg_{nullptr};
+
+        ReadAwaiter(EventLoop& loop, Reader& reader) : loop_(loop), reader_(reader) {}
+
+        bool await_ready() {
+            if (loop_.budget_ && (msg_ = reader_.read())) {
+                --loop_.budget_;
+                return true;
+            }
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            poll_ = &poll;
+            handle_ = handle;
+            loop_.park(this);
+        }
+
+        auto await_resume() { return msg_; }
+
+        static bool poll(Waiter* waiter) {
+            auto* self = static_cast<ReadAwaiter*>(waiter);
+            return (self->msg_ = self->reader_.read()) != nullptr;
+        }
+    };
+
+    Waiter* head_{nullptr};
+    Waiter* tail_{nullptr};
+    std::uint32_t budget_{0};  // left for the coroutine being resumed
+    std::size_t live_{0};      // spawned coroutines that haven't returned yet
+    bool stop_{false};
+
+    EventLoop() = default;
+
+    // coroutines still parked are destroyed without being resumed
+    ~EventLoop() {
+        for (Waiter* waiter = head_; waiter;) {
+            Waiter* next = waiter->next_;
+            waiter->handle_.destroy();
+            waiter = next;
+        }
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // next message of an SPSCQueue (or anything with front()), pop() it when done
+    template<typename Queue>
+    FrontAwaiter<Queue> front(Queue& queue) { return {*this, queue}; }
+
+    // next message of an SPMCQueue::Reader (or anything with read())
+    template<typename Reader>
+    ReadAwaiter<Reader> read(Reader& reader) { return {*this, reader}; }
+
+    // the coroutine starts on the next sweep, in spawn order
+    void spawn(Task task) {
+        const auto handle = std::exchange(task.handle_, nullptr);  // the loop owns the frame from now on
+        auto& promise = handle.promise();
+        promise.loop_ = this;
+        promise.start_.poll_ = [](Waiter*) { return true; };
+        promise.start_.handle_ = handle;
+        ++live_;
+        park(&promise.start_);
+    }
+
+    void park(Waiter* waiter) {
+        waiter->next_ = nullptr;
+        if (tail_) {
+            tail_->next_ = waiter;
+        } else {
+            head_ = waiter;
+        }
+        tail_ = waiter;
+    }
+
+    /**
+     * One sweep over the coroutines parked when it starts, returns how many were resumed.
+     * Resumed coroutines that park again are appended behind the sweep and polled on the next one.
+     */
+    std::size_t runOnce() {
+        std::size_t resumed = 0;
+        Waiter* last = tail_;
+        Waiter* prev = nullptr;
+        Waiter* waiter = head_;
+        while (waiter) {
+            Waiter* next = waiter->next_;
+            const bool end = waiter == last;
+            if (waiter->poll_(waiter)) {
+                // unlink first, the coroutine may park again (at the tail) before resume() returns
+                if (prev) {
+                    prev->next_ = next;
+                } else {
+                    head_ = next;
+                }
+                if (tail_ == waiter) tail_ = prev;
+                budget_ = BATCH - 1;  // poll_ has fetched the first message already
+                ++resumed;
+                waiter->handle_.resume();
+            } else {
+                prev = waiter;
+            }
+            if (end) break;
+            waiter = next;
+        }
+        return resumed;
+    }
+
+    // sweeps until every coroutine has returned or stop() is called
+    void run() {
+        stop_ = false;
+        while (live_ && !stop_) {
+            if (!runOnce()) {
+                cpuRelax();
+            }
+        }
+    }
+
+    void stop() { stop_ = true; }
+};
+
+#endif //CONCURRENCY_EVENT_LOOP_H
@@ -0,0 +1,139 @@
+#include "event_loop.h"
+#include "spmc.h"
+#include "spsc.h"
+#include "topology.h"
+
+#include <memory>
+#include <vector>
+
+/**
+ * Per-message cost of EventLoop coroutines against a hand-written poll loop, 40 SPSCQueues and 4 SPMCQueue readers
+ * like a gateway. Both sides run on one pinned thread so that only the consumer's work is measured: every round
+ * writes the messages, then times how long draining them takes.
+ *   dense:  64 messages in every queue per round, mostly the batch draining path (no suspension)
+ *   sparse: one message in one queue per round, mostly the cost of sweeping the idle queues
+ * usage: event_loop_bench [rounds]
+ */
+
+struct Msg {
+    std::uint64_t value_;
+    char data_[56];
+};
+
+constexpr std::size_t SPSC_QUEUES = 40;
+constexpr std::size_t SPMC_QUEUES = 4;
+constexpr std::uint32_t BATCH = EventLoop::BATCH;
+
+using Spsc = SPSCQueue<Msg, 1024>;
+using Spmc = SPMCQueue<Msg, 1024>;
+
+struct Gateway {
+    std::vector<std::unique_ptr<Spsc>> spsc_;
+    std::vector<std::unique_ptr<Spmc>> spmc_;
+    std::vector<Spmc::Reader> readers_;
+    std::uint64_t sum_{0};
+    std::uint64_t consumed_{0};
+
+    Gateway() {
+        for (std::size_t i = 0; i < SPSC_QUEUES; ++i) spsc_.push_back(std::make_unique<Spsc>());
+        for (std::size_t i = 0; i < SPMC_QUEUES; ++i) {
+            spmc_.push_back(std::make_unique<Spmc>());
+            readers_.push_back(spmc_.back()->getReader());
+        }
+    }
+
+    // queue i: the SPSCQueues first, then the SPMCQueues
+    void write(std::size_t i, std::uint64_t value) {
+        if (i < SPSC_QUEUES) {
+            spsc_[i]->blockPush([value](Msg* m) { m->value_ = value; });
+        } else {
+            spmc_[i - SPSC_QUEUES]->write([value](Msg& m) { m.value_ = value; });
+        }
+    }
+};
+
+// the same handling as the coroutines: one bounded batch per queue per sweep
+void pollLoop(Gateway& g, std::uint64_t target) {
+    while (g.consumed_ < target) {
+        for (auto& q: g.spsc_) {
+            Msg* m;
+            for (std::uint32_t n = 0; n < BATCH && (m = q->front()); ++n) {
+                g.sum_ += m->value_;
+                ++g.consumed_;
+                q->pop();
+            }
+        }
+        for (auto& r: g.readers_) {
+            Msg* m;
+            for (std::uint32_t n = 0; n < BATCH && (m = r.read()); ++n) {
+                g.sum_ += m->value_;
+                ++g.consumed_;
+            }
+        }
+    }
+}
+
+EventLoop::Task drainSpsc(EventLoop& loop, Gateway& g, Spsc& q) {
+    while (true) {
+        Msg* m = co_await loop.front(q);
+        g.sum_ += m->value_;
+        ++g.consumed_;
+        q.pop();
+    }
+}
+
+EventLoop::Task drainSpmc(EventLoop& loop, Gateway& g, Spmc::Reader& r) {
+    while (true) {
+        Msg* m = co_await loop.read(r);
+        g.sum_ += m->value_;
+        ++g.consumed_;
+    }
+}
+
+template<typename Consume>
+void run(const char* name, bool dense, std::uint64_t rounds, Consume consume) {
+    Gateway g;
+    EventLoop loop;
+    for (auto& q: g.spsc_) loop.spawn(drainSpsc(loop, g, *q));
+    for (auto& r: g.readers_) loop.spawn(drainSpmc(loop, g, r));
+    loop.runOnce();  // starts the coroutines, they all park on an empty queue
+
+    constexpr std::size_t queues = SPSC_QUEUES + SPMC_QUEUES;
+    std::uint64_t cycles = 0;
+    std::uint64_t value = 0;
+    std::uint64_t expected = 0;
+    for (std::uint64_t round = 0; round < rounds; ++round) {
+        if (dense) {
+            for (std::size_t i = 0; i < queues; ++i) {
+                for (std::uint32_t n = 0; n < 64; ++n) {
+                    g.write(i, ++value);
+                    expected += value;
+                }
+            }
+        } else {
+            g.write(round % queues, ++value);
+            expected += value;
+        }
+        const auto start = rdtscp();
+        consume(g, loop, dense ? g.consumed_ + queues * 64 : g.consumed_ + 1);
+        cycles += rdtscp() - start;
+    }
+    std::cout << name << (dense ? " dense " : " sparse") << " " << cyclesToNs(cycles) / g.consumed_ << " ns/msg"
+              << (g.sum_ == expected ? "" : " WRONG SUM") << std::endl;
+}
+
+int main(int argc, char** argv) {
+    const std::uint64_t rounds = argc > 1 ? std::stoull(argv[1]) : 10'000;
+    tscCalibration();
+    pinRole(0, 1);
+
+    for (bool dense: {true, false}) {
+        const auto n = dense ? rounds : rounds * 10;
+        run("poll loop ", dense, n, [](Gateway& g, EventLoop&, std::uint64_t target) { pollLoop(g, target); });
+        run("event loop", dense, n, [](Gateway& g, EventLoop& loop, std::uint64_t target) {
+            while (g.consumed_ < target) loop.runOnce();
+        });
+    }
+
+    return 0;
+}
@@ -0,0 +1,329 @@
+#include "spsc.h"
+#include "spmc.h"
+#include "topology.h"
+
+#include <mqueue.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+/**
+ * Baseline IPC transports next to the shm queues, all moving SampleMsg between two processes:
+ *   pipe, unix stream socket, unix datagram socket, eventfd + shared ring (SPSCQueue parked on EventFdWait),
+ *   POSIX message queue, mutex/condvar ring, and the spinning SPSCQueue / SPMCQueue
+ * ping-pong: round trip of one message at a time, the sender records the rtt
+ * stream: the sender pushes as fast as the transport lets it, the receiver records the one-way latency
+ * usage: ipc_bench [msgs] [pipe|uds_stream|uds_dgram|eventfd|mq|condvar|spsc|spmc ...]
+ */
+
+constexpr std::uint32_t RING_CNT = 1024;
+
+// anonymous shared memory, inherited by the forked peer
+template<typename T>
+T* mapShared() {
+    void* ptr = mmap(nullptr, sizeof(T), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        std::cerr << "Failed to map shared memory: " << strerror(errno) << std::endl;
+        exit(1);
+    }
+    return new(ptr) T();
+}
+
+template<typename T>
+void unmapShared(T* ptr) {
+    ptr->~T();
+    munmap(ptr, sizeof(T));
+}
+
+void writeAll(int fd, const void* buf, std::size_t len) {
+    const auto* p = static_cast<const char*>(buf);
+    while (len) {
+        auto ret = write(fd, p, len);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "write: " << strerror(errno) << std::endl;
+            exit(1);
+        }
+        p += ret;
+        len -= static_cast<std::size_t>(ret);
+    }
+}
+
+void readAll(int fd, void* buf, std::size_t len) {
+    auto* p = static_cast<char*>(buf);
+    while (len) {
+        auto ret = read(fd, p, len);
+        if (ret <= 0) {
+            if (ret < 0 && errno == EINTR) continue;
+            std::cerr << "read: " << (ret ? strerror(errno) : "eof") << std::endl;
+            exit(1);
+        }
+        p += ret;
+        len -= static_cast<std::size_t>(ret);
+    }
+}
+
+// every channel is one direction: send() on one side, recv() on the other, both block
+
+struct PipeChannel {
+    int fds_[2]{-1, -1};
+
+    PipeChannel() {
+        if (pipe(fds_)) {
+            std::cerr << "pipe: " << strerror(errno) << std::endl;
+            exit(1);
+        }
+    }
+
+    ~PipeChannel() {
+        close(fds_[0]);
+        close(fds_[1]);
+    }
+
+    void send(const SampleMsg& msg) { writeAll(fds_[1], &msg, sizeof(msg)); }
+
+    void recv(SampleMsg& msg) { readAll(fds_[0], &msg, sizeof(msg)); }
+};
+
+// SOCK_STREAM or SOCK_DGRAM
+template<int Type>
+struct UnixSocketChannel {
+    int fds_[2]{-1, -1};
+
+    UnixSocketChannel() {
+        if (socketpair(AF_UNIX, Type, 0, fds_)) {
+            std::cerr << "socketpair: " << strerror(errno) << std::endl;
+            exit(1);
+        }
+    }
+
+    ~UnixSocketChannel() {
+        close(fds_[0]);
+        close(fds_[1]);
+    }
+
+    // a datagram is written and read whole, a stream may be split so loop on it
+    void send(const SampleMsg& msg) { writeAll(fds_[0], &msg, sizeof(msg)); }
+
+    void recv(SampleMsg& msg) { readAll(fds_[1], &msg, sizeof(msg)); }
+};
+
+struct MessageQueueChannel {
+    mqd_t mq_{-1};
+
+    MessageQueueChannel() {
+        static int cnt = 0;
+        const auto name = "/ipc_bench_" + std::to_string(getpid()) + "_" + std::to_string(cnt++);
+        mq_attr attr{};
+        attr.mq_maxmsg = 10;  // default /proc/sys/fs/mqueue/msg_max
+        attr.mq_msgsize = sizeof(SampleMsg);
+        mq_ = mq_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600, &attr);
+        if (mq_ == -1) {
+            std::cerr << "mq_open: " << strerror(errno) << std::endl;
+            exit(1);
+        }
+        // the descriptor is all we need, it survives the fork
+        mq_unlink(name.c_str());
+    }
+
+    ~MessageQueueChannel() { mq_close(mq_); }
+
+    void send(const SampleMsg& msg) {
+        while (mq_send(mq_, reinterpret_cast<const char*>(&msg), sizeof(msg), 0) && errno == EINTR) {}
+    }
+
+    void recv(SampleMsg& msg) {
+        while (mq_receive(mq_, reinterpret_cast<char*>(&msg), sizeof(msg), nullptr) < 0 && errno == EINTR) {}
+    }
+};
+
+// the classic bounded buffer, process shared
+struct CondVarRing {
+    pthread_mutex_t mutex_;
+    pthread_cond_t not_empty_;
+    pthread_cond_t not_full_;
+    std::uint64_t write_idx_{0};
+    std::uint64_t read_idx_{0};
+    std::array<SampleMsg, RING_CNT> data_;
+
+    CondVarRing() {
+        pthread_mutexattr_t mutex_attr;
+        pthread_mutexattr_init(&mutex_attr);
+        pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutex_init(&mutex_, &mutex_attr);
+        pthread_mutexattr_destroy(&mutex_attr);
+        pthread_condattr_t cond_attr;
+        pthread_condattr_init(&cond_attr);
+        pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+        pthread_cond_init(&not_empty_, &cond_attr);
+        pthread_cond_init(&not_full_, &cond_attr);
+        pthread_condattr_destroy(&cond_attr);
+    }
+
+    ~CondVarRing() {
+        pthread_cond_destroy(&not_full_);
+        pthread_cond_destroy(&not_empty_);
+        pthread_mutex_destroy(&mutex_);
+    }
+};
+
+struct CondVarChannel {
+    CondVarRing* ring_{mapShared<CondVarRing>()};
+
+    ~CondVarChannel() { unmapShared(ring_); }
+
+    void send(const SampleMsg& msg) {
+        pthread_mutex_lock(&ring_->mutex_);
+        while (ring_->write_idx_ - ring_->read_idx_ == RING_CNT) {
+            pthread_cond_wait(&ring_->not_full_, &ring_->mutex_);
+        }
+        ring_->data_[ring_->write_idx_++ % RING_CNT] = msg;
+        pthread_cond_signal(&ring_->not_empty_);
+        pthread_mutex_unlock(&ring_->mutex_);
+    }
+
+    void recv(SampleMsg& msg) {
+        pthread_mutex_lock(&ring_->mutex_);
+        while (ring_->write_idx_ == ring_->read_idx_) {
+            pthread_cond_wait(&ring_->not_empty_, &ring_->mutex_);
+        }
+        msg = ring_->data_[ring_->read_idx_++ % RING_CNT];
+        pthread_cond_signal(&ring_->not_full_);
+        pthread_mutex_unlock(&ring_->mutex_);
+    }
+};
+
+// BusySpinWait is the shm path, EventFdWait<0> is eventfd + shared buffer (the consumer always sleeps in poll)
+template<typename Wait>
+struct SPSCChannel {
+    using Queue = SPSCQueue<SampleMsg, RING_CNT, Wait>;
+    Queue* queue_{mapShared<Queue>()};
+
+    ~SPSCChannel() { unmapShared(queue_); }
+
+    void send(const SampleMsg& msg) {
+        queue_->blockPush([&msg](SampleMsg* p) { *p = msg; });
+    }
+
+    void recv(SampleMsg& msg) {
+        msg = *queue_->waitFront();
+        queue_->pop();
+    }
+};
+
+// lossy, a lapped receiver skips ahead and the stream reports the drops
+struct SPMCChannel {
+    using Queue = SPMCQueue<SampleMsg, RING_CNT>;
+    Queue* queue_{mapShared<Queue>()};
+    Queue::Reader reader_{queue_->getReader()};  // joined before the fork so nothing is missed
+
+    ~SPMCChannel() { unmapShared(queue_); }
+
+    void send(const SampleMsg& msg) {
+        queue_->write([&msg](SampleMsg& p) { p = msg; });
+    }
+
+    void recv(SampleMsg& msg) {
+        while (reader_.copy(msg).status == Queue::ReadStatus::Empty) {}
+    }
+};
+
+std::uint64_t msgSeq(const SampleMsg& msg) {
+    std::uint64_t seq;
+    std::memcpy(&seq, msg.buffer, sizeof(seq));
+    return seq;
+}
+
+void setMsgSeq(SampleMsg& msg, std::uint64_t seq) {
+    std::memcpy(msg.buffer, &seq, sizeof(seq));
+}
+
+template<typename Channel>
+void pingPong(const std::string& name, std::uint64_t msgs) {
+    Channel ping;
+    Channel pong;
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+        pinRole(1, 2);
+        SampleMsg msg;
+        for (std::uint64_t i = 0; i < msgs; ++i) {
+            ping.recv(msg);
+            pong.send(msg);
+        }
+        _exit(0);
+    }
+    pinRole(0, 2);
+    LatencyHistogram rtt;
+    SampleMsg msg{};
+    for (std::uint64_t i = 0; i < msgs; ++i) {
+        setMsgSeq(msg, i);
+        msg.timestamp = rdtscp();
+        ping.send(msg);
+        pong.recv(msg);
+        rtt.record(rdtscp() - msg.timestamp);
+    }
+    waitpid(pid, nullptr, 0);
+    rtt.print(std::cout, (name + " ping-pong rtt").c_str());
+}
+
+template<typename Channel>
+void stream(const std::string& name, std::uint64_t msgs) {
+    Channel channel;
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+        pinRole(1, 2);
+        const auto& tsc = tscCalibration();
+        LatencyHistogram lat;
+        SampleMsg msg;
+        std::uint64_t received = 0;
+        std::uint64_t start = 0;
+        do {
+            channel.recv(msg);
+            const auto now = rdtscp();
+            if (!received) start = now;
+            const auto latency = now - std::min<std::uint64_t>(now, msg.timestamp);
+            lat.record(latency - std::min<std::uint64_t>(latency, tsc.rdtscp_overhead));
+            ++received;
+        } while (msgSeq(msg) != msgs - 1);
+        const double secs = cyclesToNs(rdtscp() - start) / 1e9;
+        lat.print(std::cout, (name + " stream latency").c_str());
+        std::cout << name << " stream throughput: " << static_cast<std::uint64_t>(static_cast<double>(received) / secs)
+                  << " msgs/s dropped: " << msgs - received << std::endl;
+        _exit(0);
+    }
+    pinRole(0, 2);
+    SampleMsg msg{};
+    for (std::uint64_t i = 0; i < msgs; ++i) {
+        setMsgSeq(msg, i);
+        msg.timestamp = rdtscp();
+        channel.send(msg);
+    }
+    waitpid(pid, nullptr, 0);
+}
+
+template<typename Channel>
+void run(const std::string& name, std::uint64_t msgs) {
+    pingPong<Channel>(name, msgs);
+    stream<Channel>(name, msgs);
+}
+
+int main(int argc, char** argv) {
+    const std::uint64_t msgs = argc > 1 ? std::stoull(argv[1]) : 100'000;
+    std::set<std::string> selected(argv + std::min(argc, 2), argv + argc);
+    auto enabled = [&selected](const std::string& name) { return selected.empty() || selected.count(name); };
+
+    tscCalibration();
+    placeCpus(2);  // sender and receiver, before the first pin
+    if (enabled("pipe")) run<PipeChannel>("pipe", msgs);
+    if (enabled("uds_stream")) run<UnixSocketChannel<SOCK_STREAM>>("uds_stream", msgs);
+    if (enabled("uds_dgram")) run<UnixSocketChannel<SOCK_DGRAM>>("uds_dgram", msgs);
+    if (enabled("eventfd")) run<SPSCChannel<EventFdWait<0>>>("eventfd", msgs);
+    if (enabled("mq")) run<MessageQueueChannel>("mq", msgs);
+    if (enabled("condvar")) run<CondVarChannel>("condvar", msgs);
+    if (enabled("spsc")) run<SPSCChannel<BusySpinWait>>("spsc", msgs);
+    if (enabled("spmc")) run<SPMCChannel>("spmc", msgs);
+
+    return 0;
+}
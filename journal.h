@@ -0,0 +1,354 @@
+#ifndef CONCURRENCY_JOURNAL_H
+#define CONCURRENCY_JOURNAL_H
+
+#include "shm_segment.h"
+#include "utils.h"
+#include "wait_strategy.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+/**
+ * Journal: record an SPMCQueue stream to a file and replay it
+ * - the tap is one more lossy reader of the queue (the writer doesn't know about it, so its path never touches I/O),
+ *   it runs on a core of its own and copy()s every message straight into a memory-mapped, append-only file
+ * - every record keeps the message's stream tsc, the tap's tsc at the time it read the message, the queue's sequence
+ *   number and how many messages it lost right before it (the tap was lapped), so gaps in a journal are visible
+ * - the stream tsc is the producer's timestamp when recordJournal() is told where the message keeps one, otherwise
+ *   it is the tap's read time. The tap reads a backlog faster than it was written, so with tap times a timed replay
+ *   only approximates the original gaps (JournalHeader::tsc_source_ says which one a journal has)
+ * - the file grows by GROW_RECORDS at a time (ftruncate) inside one large reserved mapping, half a step before it is
+ *   full; the new pages are faulted in by a helper thread, not by the tap in the middle of a burst. The record count
+ *   in the header is published once per batch: a journal can be read while it is being written and a crashed tap
+ *   leaves a valid journal of everything up to its last batch; the kernel writes the pages back in the background
+ * - the replayer writes the messages of a journal into a queue either as fast as possible or at the recorded
+ *   inter-arrival times of the stream tsc, converted with the recording machine's tsc frequency (in the header)
+ *
+ * File layout: JournalHeader, then JournalRecord<T>[count_]. The header carries typeHash<T>() like shm_segment.h,
+ * a journal is refused by a build with a different message type.
+ */
+
+static constexpr std::uint64_t JOURNAL_MAGIC = 0x4c4e524a43504900;  // "\0IPCJRNL"
+static constexpr std::uint32_t JOURNAL_VERSION = 2;
+
+// where JournalRecord::tsc_ comes from
+enum class JournalTsc : std::uint32_t {
+    Tap,       // the tap's read time, timed replay approximates the original gaps
+    Producer,  // the producer's timestamp in the message
+};
+
+struct alignas(64) JournalHeader {
+    std::uint64_t magic_;
+    std::uint32_t version_;
+    std::uint32_t record_size_;
+    std::uint64_t type_hash_;
+    double ns_per_cycle_;                 // of the recording machine
+    std::atomic<std::uint64_t> count_;    // records written, updated once per batch
+    JournalTsc tsc_source_;
+};
+
+template<typename T>
+struct JournalRecord {
+    std::uint64_t tsc_;      // stream time of the message, see JournalHeader::tsc_source_
+    std::uint64_t tap_tsc_;  // when the tap read the message
+    std::uint32_t seq_;      // the queue's sequence number
+    std::uint32_t lost_;     // messages the tap missed right before this one
+    T msg_;
+};
+
+template<typename T>
+struct JournalWriter {
+    using Record = JournalRecord<T>;
+    static constexpr std::size_t GROW_RECORDS = 1 << 16;
+    static constexpr std::size_t PREFAULT_STOP = ~std::size_t{0};
+
+    int fd_{-1};
+    char* base_{nullptr};
+    std::size_t reserved_{0};  // bytes of address space mapped
+    std::uint64_t capacity_{0};  // records the file can hold right now
+    std::uint64_t grow_at_{0};   // count_ at which the file grows next
+    std::uint64_t count_{0};     // records written, published to the header by publish()
+    std::atomic<std::size_t> prefault_to_{0};  // bytes of the file the prefaulter should have faulted in
+    std::jthread prefaulter_;
+
+    JournalWriter() = default;
+    JournalWriter(const JournalWriter&) = delete;
+    JournalWriter& operator=(const JournalWriter&) = delete;
+
+    ~JournalWriter() { close(); }
+
+    /**
+     * Creates (truncates) the journal file. max_bytes is the address space reserved for it, the file itself only
+     * grows as records are written, by GROW_RECORDS at a time: max_bytes has to hold at least one such step.
+     * Returns false and prints why on failure.
+     */
+    bool open(const std::string& path, std::size_t max_bytes = std::size_t{64} << 30) {
+        close();
+        if (max_bytes < sizeof(JournalHeader) + GROW_RECORDS * sizeof(Record)) {
+            std::cerr << "Journal " << path << ": max_bytes " << max_bytes << " can't hold "
+                      << GROW_RECORDS << " records" << std::endl;
+            return false;
+        }
+        fd_ = ::open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+        if (fd_ == -1) {
+            std::cerr << "Failed to open journal " << path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        void* ptr = mmap(nullptr, max_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd_, 0);
+        if (ptr == MAP_FAILED) {
+            std::cerr << "Failed to map journal " << path << ": " << strerror(errno) << std::endl;
+            close();
+            return false;
+        }
+        base_ = static_cast<char*>(ptr);
+        reserved_ = max_bytes;
+        prefault_to_.store(0, std::memory_order_relaxed);
+#ifdef MADV_POPULATE_WRITE
+        prefaulter_ = std::jthread([this] { prefault(); });
+#endif
+        if (!grow()) {
+            close();
+            return false;
+        }
+        auto* h = header();
+        h->version_ = JOURNAL_VERSION;
+        h->record_size_ = sizeof(Record);
+        h->type_hash_ = typeHash<T>();
+        h->ns_per_cycle_ = tscCalibration().ns_per_cycle;
+        h->count_.store(0, std::memory_order_relaxed);
+        h->tsc_source_ = JournalTsc::Tap;
+        h->magic_ = JOURNAL_MAGIC;
+        return true;
+    }
+
+    void close() {
+        if (prefaulter_.joinable()) {
+            prefault_to_.store(PREFAULT_STOP, std::memory_order_release);
+            prefault_to_.notify_one();
+            prefaulter_.join();
+        }
+        if (base_) {
+            // the header is only backed by the file once grow() succeeded
+            if (capacity_) publish();
+            munmap(base_, reserved_);
+            base_ = nullptr;
+        }
+        if (fd_ != -1) {
+            // drop the unused tail of the last growth step
+            if (ftruncate(fd_, static_cast<off_t>(sizeof(JournalHeader) + count_ * sizeof(Record)))) {}
+            ::close(fd_);
+            fd_ = -1;
+        }
+        capacity_ = 0;
+        count_ = 0;
+    }
+
+    [[nodiscard]] JournalHeader* header() const { return reinterpret_cast<JournalHeader*>(base_); }
+
+    // slot for the next record, nullptr if the reserved address space is full or the file can't grow
+    Record* next() {
+        if (__builtin_expect(count_ == grow_at_, 0) && !grow() && count_ == capacity_) {
+            return nullptr;
+        }
+        return reinterpret_cast<Record*>(base_ + sizeof(JournalHeader)) + count_;
+    }
+
+    // the record returned by next() is complete
+    void commit() { ++count_; }
+
+    // makes the committed records visible to readers of the file
+    void publish() { header()->count_.store(count_, std::memory_order_release); }
+
+    // one more GROW_RECORDS, half a step ahead of the tap; on failure it is tried again once the file is full
+    bool grow() {
+        const auto capacity = capacity_ + GROW_RECORDS;
+        const auto bytes = sizeof(JournalHeader) + capacity * sizeof(Record);
+        grow_at_ = capacity_;
+        if (bytes > reserved_) {
+            std::cerr << "Journal is full (" << reserved_ << " bytes reserved)" << std::endl;
+            return false;
+        }
+        if (ftruncate(fd_, static_cast<off_t>(bytes))) {
+            std::cerr << "Failed to grow journal: " << strerror(errno) << std::endl;
+            return false;
+        }
+        capacity_ = capacity;
+        grow_at_ = capacity_ - GROW_RECORDS / 2;
+        // the prefaulter faults the new pages in before the tap gets there
+        prefault_to_.store(bytes, std::memory_order_release);
+        prefault_to_.notify_one();
+        return true;
+    }
+
+    // helper thread: MADV_POPULATE_WRITE on every range grow() adds, until close()
+    void prefault() {
+        std::size_t done = 0;
+        while (true) {
+            const auto to = prefault_to_.load(std::memory_order_acquire);
+            if (to == PREFAULT_STOP) return;
+            if (to == done) {
+                prefault_to_.wait(done, std::memory_order_acquire);
+                continue;
+            }
+#ifdef MADV_POPULATE_WRITE
+            const auto first = done & ~std::size_t{4095};
+            madvise(base_ + first, to - first, MADV_POPULATE_WRITE);
+#endif
+            done = to;
+        }
+    }
+};
+
+// read-only view of a journal file, can be opened while the tap is still writing it
+template<typename T>
+struct JournalReader {
+    using Record = JournalRecord<T>;
+
+    const char* base_{nullptr};
+    std::size_t size_{0};
+
+    JournalReader() = default;
+    JournalReader(const JournalReader&) = delete;
+    JournalReader& operator=(const JournalReader&) = delete;
+
+    ~JournalReader() {
+        if (base_) munmap(const_cast<char*>(base_), size_);
+    }
+
+    bool open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            std::cerr << "Failed to open journal " << path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        struct stat st{};
+        fstat(fd, &st);
+        size_ = static_cast<std::size_t>(st.st_size);
+        if (size_ < sizeof(JournalHeader)) {
+            std::cerr << "Journal " << path << " is too small to hold a header" << std::endl;
+            ::close(fd);
+            return false;
+        }
+        void* ptr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (ptr == MAP_FAILED) {
+            std::cerr << "Failed to map journal " << path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        base_ = static_cast<const char*>(ptr);
+
+        const char* error = nullptr;
+        const auto* h = header();
+        if (h->magic_ != JOURNAL_MAGIC) {
+            error = "bad magic, not a journal";
+        } else if (h->version_ != JOURNAL_VERSION) {
+            error = "version mismatch";
+        } else if (h->record_size_ != sizeof(Record) || h->type_hash_ != typeHash<T>()) {
+            error = "message type mismatch";
+        }
+        if (error) {
+            std::cerr << "Refusing journal " << path << ": " << error << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    [[nodiscard]] const JournalHeader* header() const { return reinterpret_cast<const JournalHeader*>(base_); }
+
+    // records published so far that fit in our mapping
+    [[nodiscard]] std::uint64_t count() const {
+        const auto mapped = (size_ - sizeof(JournalHeader)) / sizeof(Record);
+        return std::min<std::uint64_t>(header()->count_.load(std::memory_order_acquire), mapped);
+    }
+
+    [[nodiscard]] const Record& operator[](std::uint64_t i) const {
+        return reinterpret_cast<const Record*>(base_ + sizeof(JournalHeader))[i];
+    }
+};
+
+/**
+ * The tap: reads the queue with copy() into the journal until stop is set, publishing the count every `batch`
+ * records or when the queue runs dry. Returns the number of records written.
+ * stream_tsc(const T&) returns the producer's tsc of a message; without it the tap's read time is recorded as the
+ * stream time (JournalTsc::Tap).
+ */
+template<typename Queue, typename T, typename StreamTsc = std::nullptr_t>
+std::uint64_t recordJournal(Queue& queue, JournalWriter<T>& journal, const std::atomic<bool>& stop,
+                            typename Queue::JoinFrom from = Queue::JoinFrom::Next, std::uint32_t batch = 256,
+                            StreamTsc stream_tsc = nullptr) {
+    constexpr bool producer_tsc = !std::is_null_pointer_v<StreamTsc>;
+    journal.header()->tsc_source_ = producer_tsc ? JournalTsc::Producer : JournalTsc::Tap;
+    auto reader = queue.getReader(from);
+    std::uint32_t pending = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+        auto* record = journal.next();
+        if (!record) break;
+        const auto result = reader.copy(record->msg_);
+        if (result.status == Queue::ReadStatus::Empty) {
+            if (pending) {
+                journal.publish();
+                pending = 0;
+            }
+            cpuRelax();
+            continue;
+        }
+        record->tap_tsc_ = rdtscp();
+        if constexpr (producer_tsc) {
+            record->tsc_ = stream_tsc(record->msg_);
+        } else {
+            record->tsc_ = record->tap_tsc_;
+        }
+        record->seq_ = reader.lastSeq();
+        record->lost_ = result.overrun;
+        journal.commit();
+        if (++pending == batch) {
+            journal.publish();
+            pending = 0;
+        }
+    }
+    journal.publish();
+    return journal.count_;
+}
+
+enum class ReplaySpeed : std::uint8_t {
+    Fast,   // back to back
+    Timed,  // at the recorded inter-arrival times
+};
+
+/**
+ * Writes records [first, last) of the journal into the queue (anything with write(fn(T&))).
+ * Timed replay keeps the gaps between the records' stream tsc relative to the first record, scaled by 1 / rate
+ * (rate 2 = twice as fast). With a JournalTsc::Tap journal those are the tap's read times, not the producer's.
+ * Messages that are already late go out back to back until the replay is on schedule again.
+ */
+template<typename T, typename Queue>
+std::uint64_t replayJournal(const JournalReader<T>& journal, Queue& queue, ReplaySpeed speed, double rate = 1.0,
+                            std::uint64_t first = 0, std::uint64_t last = ~std::uint64_t{0}) {
+    last = std::min(last, journal.count());
+    if (first >= last) return 0;
+    const double cycles_per_recorded = journal.header()->ns_per_cycle_ / tscCalibration().ns_per_cycle / rate;
+    const auto recorded_start = journal[first].tsc_;
+    const auto start = rdtsc();
+    for (auto i = first; i < last; ++i) {
+        const auto& record = journal[i];
+        if (speed == ReplaySpeed::Timed) {
+            const auto due = start + static_cast<std::uint64_t>(
+                    static_cast<double>(record.tsc_ - recorded_start) * cycles_per_recorded);
+            while (rdtsc() < due) {
+                cpuRelax();
+            }
+        }
+        queue.write([&record](T& msg) { msg = record.msg_; });
+    }
+    return last - first;
+}
+
+#endif //CONCURRENCY_JOURNAL_H
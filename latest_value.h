@@ -0,0 +1,115 @@
+#ifndef CONCURRENCY_LATEST_VALUE_H
+#define CONCURRENCY_LATEST_VALUE_H
+
+#include "utils.h"
+#include "wait_strategy.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * LatestValue: a conflated single-writer channel that only keeps the current value, e.g. a top of book or a config
+ * blob, for any number of readers in this process or others (put it in shmMap, a zero-filled one is valid and empty)
+ * - a seqlock: the writer makes seq_ odd, writes the value in place, then makes it even again. Readers copy the
+ *   value out and keep the copy only if seq_ was the same even number before and after, otherwise they retry
+ * - readers never write shared memory, so any number of them costs the writer nothing (no cache line bouncing back)
+ * - a snapshot is O(1) whatever happened since the last one; the versions in between are gone, a Reader reports how
+ *   many it missed
+ * T must be trivially copyable, it is copied with memcpy while the writer may be changing it.
+ */
+
+template<typename T>
+struct LatestValue {
+    static_assert(std::is_trivially_copyable_v<T>, "LatestValue requires a trivially copyable T");
+
+    // result of Reader::copy()
+    enum class ReadStatus : std::uint8_t {
+        Unchanged,  // nothing written since the last snapshot, or nothing written at all
+        Ok,         // copied the current value, missed is the number of versions skipped right before it
+    };
+
+    struct CopyResult {
+        ReadStatus status;
+        std::uint64_t missed;
+    };
+
+    struct Reader {
+        const LatestValue* value_{nullptr};
+        std::uint64_t version_{0};  // version of the last snapshot, the one before the current when created
+        std::uint64_t missed_{0};   // versions skipped since the reader was created
+
+        Reader() = default;
+        // the first copy() returns the current value, the versions written before the reader existed don't count
+        // as missed
+        explicit Reader(const LatestValue* value) : value_(value) {
+            const auto version = value->version();
+            version_ = version ? version - 1 : 0;
+        }
+
+        CopyResult copy(T& out) {
+            const auto version = value_->load(out, version_);
+            if (!version) return {ReadStatus::Unchanged, 0};
+            const auto missed = version - version_ - 1;
+            missed_ += missed;
+            version_ = version;
+            return {ReadStatus::Ok, missed};
+        }
+
+        // spins until there is a version newer than the last snapshot
+        CopyResult waitCopy(T& out) {
+            while (true) {
+                const auto result = copy(out);
+                if (result.status == ReadStatus::Ok) return result;
+                cpuRelax();
+            }
+        }
+    };
+
+    alignas(64) std::atomic<std::uint64_t> seq_{0};  // 2 * version, odd while the writer is in the middle of one
+    alignas(64) T value_{};
+
+    Reader getReader() const { return Reader(this); }
+
+    // versions written so far
+    [[nodiscard]] std::uint64_t version() const { return seq_.load(std::memory_order_acquire) / 2; }
+
+    // Writer is a function that takes a reference to the value and updates it in place
+    template<typename Writer>
+    void write(Writer writer) {
+        const auto seq = seq_.load(std::memory_order_relaxed);
+        seq_.store(seq + 1, std::memory_order_relaxed);
+        // orders the odd seq_ before the value stores, only a compiler barrier on x86
+        std::atomic_thread_fence(std::memory_order_release);
+        writer(value_);
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    void store(const T& value) {
+        write([&value](T& v) { std::memcpy(&v, &value, sizeof(T)); });
+    }
+
+    /**
+     * Copies a consistent value into out if its version is newer than `after`, returns the version copied or 0.
+     * The copy is retried while the writer is in the middle of an update, so a reader can spin here for as long
+     * as one write() takes.
+     */
+    std::uint64_t load(T& out, std::uint64_t after = 0) const {
+        while (true) {
+            const auto seq = seq_.load(std::memory_order_acquire);
+            if (seq / 2 <= after && !(seq & 1)) return 0;
+            if (__builtin_expect(!(seq & 1), 1)) {
+                std::memcpy(&out, &value_, sizeof(T));
+                // orders the copy before the check, only a compiler barrier on x86
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (__builtin_expect(seq_.load(std::memory_order_relaxed) == seq, 1)) {
+                    return seq / 2;
+                }
+            }
+            cpuRelax();
+        }
+    }
+};
+
+#endif //CONCURRENCY_LATEST_VALUE_H
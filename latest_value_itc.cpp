@@ -0,0 +1,147 @@
+#include "latest_value.h"
+#include "spmc.h"
+#include "topology.h"
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <memory>
+#include <vector>
+
+/**
+ * Conflated reads of a top of book
+ *   snapshot: one writer updates a LatestValue<TopOfBook> in shm, READERS forked processes take snapshots until
+ *             they see the last version and check that every one is consistent (no field from another version)
+ *   backlog:  the newest message of an SPMCQueue with n messages pending, copyLast() against draining with copy()
+ * usage: latest_value_itc [updates]
+ */
+
+struct TopOfBook {
+    std::uint64_t version_;
+    double bid_;
+    double ask_;
+    std::uint32_t bid_qty_;
+    std::uint32_t ask_qty_;
+    std::uint64_t tsc_;
+    char symbol_[8];
+};
+
+using Book = LatestValue<TopOfBook>;
+constexpr int READERS = 3;
+
+// per reader, in shm so that the forked readers can report back
+struct Stats {
+    std::uint64_t snapshots_;
+    std::uint64_t missed_;
+    std::uint64_t bad_;
+};
+
+void fill(TopOfBook& b, std::uint64_t i) {
+    b.version_ = i;
+    b.bid_ = 100.0 + static_cast<double>(i % 1000) / 100;
+    b.ask_ = b.bid_ + 0.01;
+    b.bid_qty_ = static_cast<std::uint32_t>(i * 3);
+    b.ask_qty_ = static_cast<std::uint32_t>(i * 7);
+    std::memcpy(b.symbol_, "ESZ4", 5);
+}
+
+bool consistent(const TopOfBook& b) {
+    TopOfBook expected{};
+    fill(expected, b.version_);
+    return b.bid_ == expected.bid_ && b.ask_ == expected.ask_ && b.bid_qty_ == expected.bid_qty_ &&
+           b.ask_qty_ == expected.ask_qty_;
+}
+
+void snapshot(std::uint64_t updates) {
+    shm_unlink("latest_value_itc");
+    shm_unlink("latest_value_itc_stats");
+    auto* book = shmMap<Book>("latest_value_itc");
+    auto* stats = shmMap<std::array<Stats, READERS>>("latest_value_itc_stats");
+    if (!book || !stats) return;
+
+    std::vector<pid_t> children;
+    for (int r = 0; r < READERS; ++r) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            pinRole(r + 1, READERS + 1);
+            auto reader = book->getReader();
+            auto& s = (*stats)[r];
+            TopOfBook b{};
+            while (reader.version_ < updates) {
+                reader.waitCopy(b);
+                ++s.snapshots_;
+                s.bad_ += !consistent(b) || b.version_ != reader.version_;
+            }
+            s.missed_ = reader.missed_;
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+    pinRole(0, READERS + 1);
+    const auto start = rdtscp();
+    for (std::uint64_t i = 1; i <= updates; ++i) {
+        book->write([i](TopOfBook& b) {
+            fill(b, i);
+            b.tsc_ = rdtsc();
+        });
+    }
+    const auto cycles = rdtscp() - start;
+    for (auto pid: children) {
+        waitpid(pid, nullptr, 0);
+    }
+    std::cout << "snapshot writer " << cyclesToNs(cycles) / static_cast<double>(updates) << " ns/update\n";
+    for (int r = 0; r < READERS; ++r) {
+        const auto& s = (*stats)[r];
+        std::cout << "  reader " << r << " snapshots: " << s.snapshots_ << " missed: " << s.missed_
+                  << " bad: " << s.bad_ << "\n";
+    }
+    munmap(book, sizeof(Book));
+    munmap(stats, sizeof(*stats));
+    shm_unlink("latest_value_itc");
+    shm_unlink("latest_value_itc_stats");
+}
+
+using BookQueue = SPMCQueue<TopOfBook, 1024>;
+
+void backlog() {
+    auto queue = std::make_unique<BookQueue>();
+    std::uint64_t i = 0;
+    for (std::uint32_t pending: {1u, 16u, 256u, 1000u}) {
+        constexpr int rounds = 1000;
+        std::uint64_t drain_cycles = 0;
+        std::uint64_t last_cycles = 0;
+        std::uint64_t bad = 0;
+        auto drain_reader = queue->getReader();
+        auto last_reader = queue->getReader();
+        for (int round = 0; round < rounds; ++round) {
+            for (std::uint32_t n = 0; n < pending; ++n) {
+                queue->write([v = ++i](TopOfBook& b) { fill(b, v); });
+            }
+            TopOfBook b{};
+            TopOfBook newest{};
+            auto start = rdtscp();
+            while (drain_reader.copy(b).status == BookQueue::ReadStatus::Ok) newest = b;
+            drain_cycles += rdtscp() - start;
+            bad += newest.version_ != i;
+
+            start = rdtscp();
+            const auto result = last_reader.copyLast(b);
+            last_cycles += rdtscp() - start;
+            bad += b.version_ != i || result.overrun != pending - 1;
+        }
+        std::cout << "backlog " << std::setw(4) << pending << " drain " << cyclesToNs(drain_cycles) / rounds
+                  << " ns copyLast " << cyclesToNs(last_cycles) / rounds << " ns" << (bad ? " WRONG" : "") << "\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    const std::uint64_t updates = argc > 1 ? std::stoull(argv[1]) : 10'000'000;
+    tscCalibration();
+    placeCpus(READERS + 1);
+
+    snapshot(updates);
+    backlog();
+
+    return 0;
+}
@@ -0,0 +1,155 @@
+#ifndef CONCURRENCY_MPSC_H
+#define CONCURRENCY_MPSC_H
+
+#include "spsc.h"
+
+#include <array>
+#include <atomic>
+
+/**
+ * MPSCQueue: fan-in built from one SPSCQueue lane per producer
+ * - producers never contend with each other, each one owns a lane for as long as it is registered
+ * - producers register/unregister at runtime, also from other processes when the queue lives in shmMap
+ * - the consumer drains the active lanes either round-robin (cheapest) or merged by the rdtscp stamp taken at push
+ *   (approximate global order across producers)
+ *
+ * Lane life cycle: Free -> Active (producer, CAS) -> Closing (producer) -> Free (consumer, once the lane is empty)
+ * so messages pushed before unregistering are never lost.
+ */
+
+template<typename T, std::uint32_t Cnt, std::uint32_t MaxLanes>
+struct MPSCQueue {
+    enum LaneState : std::uint32_t {
+        Free = 0,  // 0 so that a zero-filled shm segment is a valid empty queue
+        Active,
+        Closing,
+    };
+
+    struct Entry {
+        std::uint64_t tsc_;
+        T data_;
+    };
+
+    struct Lane {
+        alignas(64) std::atomic<std::uint32_t> state_{Free};
+        SPSCQueue<Entry, Cnt> queue_;
+    };
+
+    struct Producer {
+        MPSCQueue* queue_{nullptr};
+        Lane* lane_{nullptr};
+
+        T* alloc() {
+            auto* entry = lane_->queue_.alloc();
+            return entry ? &entry->data_ : nullptr;
+        }
+
+        // stamps the message for the merged drain order, then publishes it
+        void push() {
+            lane_->queue_.writeAt(0)->tsc_ = rdtscp();
+            lane_->queue_.push();
+        }
+
+        template<typename Writer>
+        bool tryPush(Writer writer) {
+            T* p = alloc();
+            if (!p) return false;
+            writer(p);
+            push();
+            return true;
+        }
+
+        template<typename Writer>
+        void blockPush(Writer writer) {
+            while (!tryPush(writer)) {}
+        }
+
+        explicit operator bool() const { return lane_; }
+    };
+
+    std::array<Lane, MaxLanes> lanes_;
+    alignas(64) std::atomic<std::uint32_t> lane_cnt_{0};  // high-water mark of used lanes, bounds the consumer scan
+    alignas(64) std::uint32_t next_lane_{0};              // consumer only, round-robin position
+
+    // returns an invalid Producer if all lanes are taken
+    Producer registerProducer() {
+        for (std::uint32_t i = 0; i < MaxLanes; ++i) {
+            std::uint32_t expected = Free;
+            if (lanes_[i].state_.compare_exchange_strong(expected, Active, std::memory_order_acquire,
+                                                         std::memory_order_relaxed)) {
+                auto cnt = lane_cnt_.load(std::memory_order_relaxed);
+                while (cnt < i + 1 && !lane_cnt_.compare_exchange_weak(cnt, i + 1, std::memory_order_release)) {}
+                return Producer{this, &lanes_[i]};
+            }
+        }
+        return Producer{};
+    }
+
+    // the lane is handed back to the pool by the consumer after it has drained what is left
+    void unregisterProducer(Producer& producer) {
+        producer.lane_->state_.store(Closing, std::memory_order_release);
+        producer.lane_ = nullptr;
+    }
+
+    // round-robin over the lanes, at most one message per lane per call
+    template<typename Reader>
+    bool tryPop(Reader reader) {
+        const auto lane_cnt = lane_cnt_.load(std::memory_order_acquire);
+        for (std::uint32_t n = 0; n < lane_cnt; ++n) {
+            auto& lane = lanes_[next_lane_];
+            next_lane_ = next_lane_ + 1 < lane_cnt ? next_lane_ + 1 : 0;
+            if (Entry* entry = laneFront(lane)) {
+                reader(&entry->data_);
+                lane.queue_.pop();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // round-robin over the lanes, up to batch messages per lane with a single index update per lane
+    template<typename Reader>
+    std::size_t drain(Reader reader, std::size_t batch) {
+        const auto lane_cnt = lane_cnt_.load(std::memory_order_acquire);
+        std::size_t cnt = 0;
+        for (std::uint32_t i = 0; i < lane_cnt; ++i) {
+            auto& lane = lanes_[i];
+            if (!laneFront(lane)) continue;
+            cnt += lane.queue_.tryPopBatch(batch, [&reader](Entry* entry, std::size_t) { reader(&entry->data_); });
+        }
+        return cnt;
+    }
+
+    // pops the message with the smallest push timestamp among the lane heads
+    template<typename Reader>
+    bool tryPopOrdered(Reader reader) {
+        const auto lane_cnt = lane_cnt_.load(std::memory_order_acquire);
+        Lane* min_lane = nullptr;
+        Entry* min_entry = nullptr;
+        for (std::uint32_t i = 0; i < lane_cnt; ++i) {
+            Entry* entry = laneFront(lanes_[i]);
+            if (entry && (!min_entry || entry->tsc_ < min_entry->tsc_)) {
+                min_lane = &lanes_[i];
+                min_entry = entry;
+            }
+        }
+        if (!min_entry) return false;
+        reader(&min_entry->data_);
+        min_lane->queue_.pop();
+        return true;
+    }
+
+    // front of a lane, recycles closed lanes once they are drained
+    Entry* laneFront(Lane& lane) {
+        const auto state = lane.state_.load(std::memory_order_acquire);
+        if (state == Free) return nullptr;
+        Entry* entry = lane.queue_.front();
+        if (!entry && state == Closing) {
+            // the producer is gone and everything it pushed has been consumed
+            lane.state_.store(Free, std::memory_order_release);
+        }
+        return entry;
+    }
+};
+
+#endif //CONCURRENCY_MPSC_H
@@ -0,0 +1,133 @@
+#include "mpsc.h"
+#include "topology.h"
+
+#include <thread>
+#include <vector>
+
+/**
+ * Throughput of the lane based MPSCQueue against a CAS based shared-tail MPSC queue (Vyukov's bounded queue)
+ * at 2, 4, 8 and 16 producers. The consumer is role 0 and producer p role p + 1 of placeCpus() (see topology.h),
+ * threads are only pinned when there are enough cpus for every role or IPC_CPUS is set.
+ */
+
+struct Msg {
+    uint64_t producer_;
+    uint64_t val_;
+};
+
+const uint64_t msgs_per_producer = 1'000'000;
+
+// every producer contends on tail_, slots carry a sequence so that the consumer knows when a slot is published
+template<typename T, std::uint32_t Cnt>
+struct CasMPSCQueue {
+    static_assert(Cnt && !(Cnt & (Cnt - 1)), "Cnt must be a power of 2");
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> seq_;
+        T data_;
+    };
+
+    std::array<Slot, Cnt> slots_;
+    alignas(64) std::atomic<uint64_t> tail_{0};
+    alignas(64) uint64_t head_{0};
+
+    CasMPSCQueue() {
+        for (uint64_t i = 0; i < Cnt; ++i) {
+            slots_[i].seq_.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    template<typename Writer>
+    bool tryPush(Writer writer) {
+        auto pos = tail_.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &slots_[pos & (Cnt - 1)];
+            auto diff = static_cast<int64_t>(slot->seq_.load(std::memory_order_acquire)) - static_cast<int64_t>(pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;  // full
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        writer(&slot->data_);
+        slot->seq_.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    template<typename Reader>
+    bool tryPop(Reader reader) {
+        auto& slot = slots_[head_ & (Cnt - 1)];
+        if (slot.seq_.load(std::memory_order_acquire) != head_ + 1) return false;
+        reader(&slot.data_);
+        slot.seq_.store(head_ + Cnt, std::memory_order_release);
+        ++head_;
+        return true;
+    }
+};
+
+// Push(producer index, value) pushes a message and Pop() pops one, returns whether a message was consumed
+template<typename Push, typename Pop>
+void run(const char* name, uint64_t producers, Push push_fn, Pop pop_fn) {
+    std::vector<std::jthread> threads;
+    std::latch latch(static_cast<std::ptrdiff_t>(producers + 1));
+    for (uint64_t p = 0; p < producers; ++p) {
+        threads.emplace_back([p, producers, &push_fn, &latch] {
+            pinRoleIfAvailable(p + 1, producers + 1);
+            latch.arrive_and_wait();
+            push_fn(p);
+        });
+    }
+
+    pinRoleIfAvailable(0, producers + 1);
+    latch.arrive_and_wait();
+    const auto start = std::chrono::steady_clock::now();
+    const uint64_t total = producers * msgs_per_producer;
+    uint64_t cnt = 0;
+    while (cnt < total) {
+        cnt += pop_fn();
+    }
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    threads.clear();
+    std::cout << name << " producers: " << producers << " throughput: " << static_cast<uint64_t>(total / secs)
+              << " msgs/s" << std::endl;
+}
+
+int main() {
+    using LaneQueue = MPSCQueue<Msg, 1024, 16>;
+    using CasQueue = CasMPSCQueue<Msg, 1024>;
+
+    for (uint64_t producers : {2, 4, 8, 16}) {
+        auto* lanes = new LaneQueue();
+        run("lanes", producers,
+            [lanes](uint64_t p) {
+                auto producer = lanes->registerProducer();
+                for (uint64_t i = 0; i < msgs_per_producer; ++i) {
+                    producer.blockPush([p, i](Msg* msg) {
+                        msg->producer_ = p;
+                        msg->val_ = i;
+                    });
+                }
+                lanes->unregisterProducer(producer);
+            },
+            [lanes] { return lanes->drain([](Msg*) {}, 64); });
+        delete lanes;
+
+        auto* cas = new CasQueue();
+        run("cas  ", producers,
+            [cas](uint64_t p) {
+                for (uint64_t i = 0; i < msgs_per_producer; ++i) {
+                    while (!cas->tryPush([p, i](Msg* msg) {
+                        msg->producer_ = p;
+                        msg->val_ = i;
+                    })) {}
+                }
+            },
+            [cas] { return static_cast<std::size_t>(cas->tryPop([](Msg*) {})); });
+        delete cas;
+    }
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+#ifndef CONCURRENCY_PAYLOAD_H
+#define CONCURRENCY_PAYLOAD_H
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Large payload helpers for the queues
+ * - slot prefetching: for messages of several cache lines SPSCQueue prefetches the next free slot for writing in
+ *   alloc() and the next published slot for reading in front(), SPMCQueue prefetches the next block in write().
+ *   On by default from LARGE_PAYLOAD bytes, specialize prefetch_slots_v to force it on or off for a type.
+ * - streamCopy(): non-temporal copy (AVX-512, AVX2 or SSE2, picked at runtime) for filling a slot from the writer
+ *   callback. It skips the read-for-ownership and doesn't evict the producer's working set, but the consumer then
+ *   reads the lines from memory instead of the producer's cache: measure (payload_bench) before using it.
+ */
+
+static constexpr std::size_t CACHE_LINE = 64;
+static constexpr std::size_t LARGE_PAYLOAD = 256;
+
+template<typename T>
+inline constexpr bool prefetch_slots_v = sizeof(T) >= LARGE_PAYLOAD;
+
+// prefetchw: get the lines in exclusive state ahead of the stores, decodes as a nop on cpus without it
+inline void prefetchWrite(const void* p, std::size_t size) {
+    const auto* c = static_cast<const char*>(p);
+    for (std::size_t i = 0; i < size; i += CACHE_LINE) {
+        asm volatile("prefetchw %0" : : "m"(c[i]));
+    }
+}
+
+inline void prefetchRead(const void* p, std::size_t size) {
+    const auto* c = static_cast<const char*>(p);
+    for (std::size_t i = 0; i < size; i += CACHE_LINE) {
+        __builtin_prefetch(c + i, 0, 3);
+    }
+}
+
+__attribute__((target("avx512f"))) inline void streamCopyAvx512(char* dst, const char* src, std::size_t n) {
+    for (std::size_t i = 0; i < n; i += 64) {
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + i), _mm512_loadu_si512(src + i));
+    }
+}
+
+__attribute__((target("avx2"))) inline void streamCopyAvx2(char* dst, const char* src, std::size_t n) {
+    for (std::size_t i = 0; i < n; i += 32) {
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i),
+                            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)));
+    }
+}
+
+inline void streamCopySse2(char* dst, const char* src, std::size_t n) {
+    for (std::size_t i = 0; i < n; i += 16) {
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+    }
+}
+
+/**
+ * Non-temporal memcpy, the unaligned head and the tail go through plain memcpy.
+ * Ends with an sfence: non-temporal stores are weakly ordered and the release store that publishes the slot
+ * would not order them otherwise.
+ */
+inline void streamCopy(void* dst, const void* src, std::size_t n) {
+    static const int level = __builtin_cpu_supports("avx512f") ? 2 : __builtin_cpu_supports("avx2") ? 1 : 0;
+    auto* d = static_cast<char*>(dst);
+    const auto* s = static_cast<const char*>(src);
+    const auto head = std::min(n, (CACHE_LINE - reinterpret_cast<std::uintptr_t>(d) % CACHE_LINE) % CACHE_LINE);
+    std::memcpy(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+    const auto bulk = n & ~(CACHE_LINE - 1);
+    if (level == 2) {
+        streamCopyAvx512(d, s, bulk);
+    } else if (level == 1) {
+        streamCopyAvx2(d, s, bulk);
+    } else {
+        streamCopySse2(d, s, bulk);
+    }
+    std::memcpy(d + bulk, s + bulk, n - bulk);
+    _mm_sfence();
+}
+
+#endif //CONCURRENCY_PAYLOAD_H
@@ -0,0 +1,107 @@
+#include "spsc.h"
+#include "topology.h"
+
+#include <memory>
+#include <thread>
+
+/**
+ * Large payloads through SPSCQueue, 256B to 8KiB
+ *   plain    memcpy into the slot, no slot prefetching
+ *   prefetch memcpy into the slot, prefetchw of the next slot on alloc(), prefetch of slot k+1 on front()
+ *   stream   streamCopy() (non-temporal stores) into the slot, no slot prefetching
+ * The consumer copies every message out. Throughput is unthrottled, latency is measured with one message every
+ * 2us (from before the producer's copy to after the consumer's copy).
+ * usage: payload_bench [msgs]
+ */
+
+template<std::size_t Size, bool Prefetch>
+struct Payload {
+    std::uint64_t tsc_;
+    char data_[Size - sizeof(std::uint64_t)];
+};
+
+template<std::size_t Size, bool Prefetch>
+inline constexpr bool prefetch_slots_v<Payload<Size, Prefetch>> = Prefetch;
+
+constexpr std::uint64_t gap_ns = 2'000;
+
+template<std::size_t Size, bool Prefetch, bool Stream>
+void run(const char* name, std::uint64_t msgs) {
+    using Msg = Payload<Size, Prefetch>;
+    using Queue = SPSCQueue<Msg, 256>;
+    auto queue = std::make_unique<Queue>();
+    auto src = std::make_unique<Msg>();
+    std::memset(src->data_, 'x', sizeof(src->data_));
+
+    const auto& tsc = tscCalibration();
+    const auto gap_cycles = static_cast<std::uint64_t>(gap_ns / tsc.ns_per_cycle);
+
+    for (const bool paced: {false, true}) {
+        const auto cnt = paced ? msgs / 10 : msgs;
+        LatencyHistogram lat;
+        std::uint64_t elapsed = 0;
+        {
+            std::jthread consumer([&] {
+                pinRole(1, 2);
+                auto out = std::make_unique<Msg>();
+                const auto start = rdtscp();
+                for (std::uint64_t i = 0; i < cnt; ++i) {
+                    Msg* msg = queue->waitFront();
+                    std::memcpy(out.get(), msg, sizeof(Msg));
+                    queue->pop();
+                    const auto now = rdtscp();
+                    lat.record(now - std::min<std::uint64_t>(now, out->tsc_));
+                }
+                elapsed = rdtscp() - start;
+            });
+            std::jthread producer([&] {
+                pinRole(0, 2);
+                for (std::uint64_t i = 0; i < cnt; ++i) {
+                    src->tsc_ = rdtscp();
+                    queue->blockPush([&src](Msg* msg) {
+                        if constexpr (Stream) {
+                            streamCopy(msg, src.get(), sizeof(Msg));
+                        } else {
+                            std::memcpy(msg, src.get(), sizeof(Msg));
+                        }
+                    });
+                    if (paced) {
+                        const auto expire = rdtsc() + gap_cycles;
+                        while (rdtsc() < expire) {}
+                    }
+                }
+            });
+        }
+        std::ostringstream os;
+        os << std::setw(5) << Size << "B " << name;
+        if (paced) {
+            lat.print(std::cout, (os.str() + " paced    latency").c_str());
+        } else {
+            const double secs = cyclesToNs(elapsed) / 1e9;
+            std::cout << os.str() << " unpaced  throughput: " << static_cast<std::uint64_t>(cnt / secs) << " msgs/s "
+                      << std::fixed << std::setprecision(2) << cnt * Size / secs / 1e9 << " GB/s" << std::endl;
+            std::cout.unsetf(std::ios::fixed);
+        }
+    }
+}
+
+template<std::size_t Size>
+void runAll(std::uint64_t msgs) {
+    run<Size, false, false>("plain   ", msgs);
+    run<Size, true, false>("prefetch", msgs);
+    run<Size, false, true>("stream  ", msgs);
+}
+
+int main(int argc, char** argv) {
+    const std::uint64_t msgs = argc > 1 ? std::stoull(argv[1]) : 1'000'000;
+    tscCalibration();
+    placeCpus(2);
+    runAll<256>(msgs);
+    runAll<512>(msgs);
+    runAll<1024>(msgs);
+    runAll<2048>(msgs);
+    runAll<4096>(msgs);
+    runAll<8192>(msgs);
+
+    return 0;
+}
@@ -0,0 +1,167 @@
+#ifndef CONCURRENCY_PIPELINE_H
+#define CONCURRENCY_PIPELINE_H
+
+#include "utils.h"
+#include "wait_strategy.h"
+
+#include <array>
+#include <atomic>
+#include <initializer_list>
+
+/**
+ * Pipeline: several processing stages sharing one ring, messages are processed in place
+ * - the producer publishes sequence numbers like SPMCQueue (starting at 1)
+ * - every stage has a cursor, the last sequence it has released, and depends on the producer or on upstream stages:
+ *   it may work on seq n once all of its dependencies have released n (a sequence barrier)
+ * - the producer reuses a slot only once every final stage (one that no other stage depends on) has released it
+ * So a message is written once and its cache lines travel producer -> stage 1 -> stage 2 ... without a copy per hop.
+ * Both sides cache what they last saw of the other cursors and only reload them when they run out
+ * (the producer when the ring looks full, a stage when it has caught up with its barrier).
+ *
+ * Stages are declared with addStage() before any thread uses the pipeline. Stages with the same dependencies
+ * run in parallel on the same messages, e.g. decode -> {enrich, risk} -> publish.
+ * Lives in shmMap as well, the stages of a pipeline may be different processes.
+ */
+
+template<typename T, std::uint32_t Cnt, std::uint32_t MaxStages>
+struct Pipeline {
+    static_assert(Cnt && !(Cnt & (Cnt - 1)), "Cnt must be a power of 2");
+    static_assert(MaxStages && MaxStages <= 32, "stage dependencies are a 32-bit mask");
+
+    struct alignas(64) Cursor {
+        std::atomic<std::uint32_t> seq_{0};  // last released sequence
+    };
+
+    struct Stage {
+        Pipeline* pipeline_{nullptr};
+        std::uint32_t id_{0};
+        std::uint32_t next_{1};       // next sequence to process
+        std::uint32_t available_{0};  // barrier as last seen, everything up to it is ready for us
+
+        // the next message for this stage, nullptr if the upstream stages haven't released it yet
+        T* tryNext() {
+            if (static_cast<std::int32_t>(next_ - available_) > 0) {
+                available_ = pipeline_->barrier(id_);
+                if (static_cast<std::int32_t>(next_ - available_) > 0) return nullptr;
+            }
+            return &pipeline_->data_[next_ & (Cnt - 1)];
+        }
+
+        T* next() {
+            T* p;
+            while ((p = tryNext()) == nullptr) {
+                cpuRelax();
+            }
+            return p;
+        }
+
+        // done with the message returned by tryNext()/next(), downstream stages may have it
+        void release() {
+            pipeline_->stages_[id_].seq_.store(next_++, std::memory_order_release);
+        }
+
+        /**
+         * Processes up to max ready messages with fn(T&, seq) and releases them with a single cursor update,
+         * returns how many were processed.
+         */
+        template<typename Fn>
+        std::size_t process(Fn fn, std::size_t max = Cnt) {
+            if (static_cast<std::int32_t>(next_ - available_) > 0) {
+                available_ = pipeline_->barrier(id_);
+            }
+            const auto ready = static_cast<std::int32_t>(available_ - next_ + 1);
+            if (ready <= 0) return 0;
+            const auto cnt = std::min<std::size_t>(static_cast<std::size_t>(ready), max);
+            for (std::size_t i = 0; i < cnt; ++i) {
+                const auto seq = next_ + static_cast<std::uint32_t>(i);
+                fn(pipeline_->data_[seq & (Cnt - 1)], seq);
+            }
+            next_ += static_cast<std::uint32_t>(cnt);
+            pipeline_->stages_[id_].seq_.store(next_ - 1, std::memory_order_release);
+            return cnt;
+        }
+
+        explicit operator bool() const { return pipeline_; }
+    };
+
+    std::array<T, Cnt> data_;
+    alignas(64) std::atomic<std::uint32_t> write_idx_{0};  // last published sequence
+    alignas(64) std::uint32_t gate_cache_{0};              // producer only, slowest final stage as last seen
+    std::array<Cursor, MaxStages> stages_;
+    // setup, read-only once the pipeline runs
+    alignas(64) std::uint32_t stage_cnt_{0};
+    std::array<std::uint32_t, MaxStages> deps_{};  // bit i: depends on stage i, 0: depends on the producer
+    std::uint32_t final_mask_{0};
+
+    /**
+     * Declares a stage depending on the given upstream stages (none: on the producer), returns its id.
+     * Returns MaxStages if there is no room or a dependency doesn't exist yet.
+     */
+    std::uint32_t addStage(std::initializer_list<std::uint32_t> deps = {}) {
+        if (stage_cnt_ == MaxStages) return MaxStages;
+        const auto id = stage_cnt_;
+        std::uint32_t mask = 0;
+        for (auto dep: deps) {
+            if (dep >= id) return MaxStages;
+            mask |= 1u << dep;
+        }
+        deps_[id] = mask;
+        final_mask_ = (final_mask_ & ~mask) | (1u << id);
+        ++stage_cnt_;
+        return id;
+    }
+
+    Stage stage(std::uint32_t id) {
+        Stage s;
+        s.pipeline_ = this;
+        s.id_ = id;
+        s.next_ = stages_[id].seq_.load(std::memory_order_acquire) + 1;
+        s.available_ = s.next_ - 1;
+        return s;
+    }
+
+    // last sequence every dependency of the stage has released
+    std::uint32_t barrier(std::uint32_t id) const {
+        const auto mask = deps_[id];
+        if (!mask) return write_idx_.load(std::memory_order_acquire);
+        std::uint32_t min_seq = 0;
+        bool first = true;
+        for (std::uint32_t i = 0; i < stage_cnt_; ++i) {
+            if (!(mask & (1u << i))) continue;
+            const auto seq = stages_[i].seq_.load(std::memory_order_acquire);
+            if (first || static_cast<std::int32_t>(seq - min_seq) < 0) min_seq = seq;
+            first = false;
+        }
+        return min_seq;
+    }
+
+    // slot for the next sequence, nullptr if the final stages haven't released it yet
+    T* tryClaim() {
+        const auto seq = write_idx_.load(std::memory_order_relaxed) + 1;
+        if (seq - gate_cache_ > Cnt) {
+            gate_cache_ = seq;
+            for (std::uint32_t i = 0; i < stage_cnt_; ++i) {
+                if (!(final_mask_ & (1u << i))) continue;
+                const auto released = stages_[i].seq_.load(std::memory_order_acquire);
+                if (static_cast<std::int32_t>(released - gate_cache_) < 0) gate_cache_ = released;
+            }
+            if (seq - gate_cache_ > Cnt) return nullptr;
+        }
+        return &data_[seq & (Cnt - 1)];
+    }
+
+    T* claim() {
+        T* p;
+        while ((p = tryClaim()) == nullptr) {
+            cpuRelax();
+        }
+        return p;
+    }
+
+    // publishes the slot returned by tryClaim()/claim() to the first stages
+    void publish() {
+        write_idx_.store(write_idx_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};
+
+#endif //CONCURRENCY_PIPELINE_H
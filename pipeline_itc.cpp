@@ -0,0 +1,152 @@
+#include "pipeline.h"
+#include "spsc.h"
+#include "topology.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+/**
+ * decode -> enrich -> risk -> publish, one thread per stage plus the producer
+ *   pipeline: the stages work in place on one Pipeline ring
+ *   spsc:     a SPSCQueue per hop, every stage copies the message out and pushes it to the next queue
+ * Reports the producer to publish latency and the throughput.
+ * usage: pipeline_itc [msgs]
+ */
+
+struct Order {
+    std::uint64_t tsc_;
+    std::uint64_t id_;
+    char raw_[64];
+    double price_;
+    std::uint32_t qty_;
+    std::uint32_t symbol_;
+    double notional_;
+    double limit_;
+    bool accepted_;
+};
+
+constexpr std::size_t roles = 5;
+
+void produce(Order& order, uint64_t i) {
+    order.id_ = i;
+    std::snprintf(order.raw_, sizeof(order.raw_), "%llu|%u|%llu", static_cast<unsigned long long>(10'000 + i % 100),
+                  static_cast<unsigned>(i % 500 + 1), static_cast<unsigned long long>(i % 64));
+    order.tsc_ = rdtscp();
+}
+
+void decode(Order& order) {
+    unsigned long long price = 0;
+    unsigned qty = 0;
+    unsigned long long symbol = 0;
+    std::sscanf(order.raw_, "%llu|%u|%llu", &price, &qty, &symbol);
+    order.price_ = static_cast<double>(price) / 100;
+    order.qty_ = qty;
+    order.symbol_ = static_cast<std::uint32_t>(symbol);
+}
+
+void enrich(Order& order) {
+    order.notional_ = order.price_ * order.qty_;
+    order.limit_ = 10'000.0 * (order.symbol_ % 8 + 1);
+}
+
+void risk(Order& order) {
+    order.accepted_ = order.notional_ <= order.limit_;
+}
+
+void report(const char* name, const LatencyHistogram& lat, uint64_t msgs, uint64_t accepted, double secs) {
+    std::cout << name << " throughput: " << static_cast<uint64_t>(msgs / secs) << " msgs/s accepted: " << accepted
+              << "\n";
+    lat.print(std::cout, "  latency");
+}
+
+void runPipeline(uint64_t msgs) {
+    using OrderPipeline = Pipeline<Order, 1024, 4>;
+    auto pipeline = std::make_unique<OrderPipeline>();
+    const auto decode_id = pipeline->addStage();
+    const auto enrich_id = pipeline->addStage({decode_id});
+    const auto risk_id = pipeline->addStage({enrich_id});
+    const auto publish_id = pipeline->addStage({risk_id});
+
+    LatencyHistogram lat;
+    uint64_t accepted = 0;
+    const auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<std::jthread> threads;
+        auto runStage = [&pipeline, msgs](std::uint32_t id, auto fn) {
+            return std::jthread([&pipeline, msgs, id, fn] {
+                pinRole(id + 1, roles);
+                auto stage = pipeline->stage(id);
+                for (uint64_t done = 0; done < msgs;) {
+                    done += stage.process([&fn](Order& order, std::uint32_t) { fn(order); });
+                }
+            });
+        };
+        threads.push_back(runStage(decode_id, decode));
+        threads.push_back(runStage(enrich_id, enrich));
+        threads.push_back(runStage(risk_id, risk));
+        threads.push_back(runStage(publish_id, [&lat, &accepted](Order& order) {
+            accepted += order.accepted_;
+            lat.record(rdtscp() - order.tsc_);
+        }));
+
+        pinRole(0, roles);
+        for (uint64_t i = 0; i < msgs; ++i) {
+            produce(*pipeline->claim(), i);
+            pipeline->publish();
+        }
+    }
+    report("pipeline", lat, msgs, accepted, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+void runSpscChain(uint64_t msgs) {
+    using OrderQueue = SPSCQueue<Order, 1024>;
+    std::vector<std::unique_ptr<OrderQueue>> queues;
+    for (int i = 0; i < 4; ++i) {
+        queues.push_back(std::make_unique<OrderQueue>());
+    }
+
+    LatencyHistogram lat;
+    uint64_t accepted = 0;
+    const auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<std::jthread> threads;
+        // hop i pops from queues[i], pushes to queues[i + 1] (the last one only consumes)
+        auto runHop = [&queues, msgs](std::size_t i, auto fn) {
+            return std::jthread([&queues, msgs, i, fn] {
+                pinRole(i + 1, roles);
+                for (uint64_t n = 0; n < msgs; ++n) {
+                    Order order = *queues[i]->waitFront();
+                    queues[i]->pop();
+                    fn(order);
+                    if (i + 1 < queues.size()) {
+                        queues[i + 1]->blockPush([&order](Order* p) { *p = order; });
+                    }
+                }
+            });
+        };
+        threads.push_back(runHop(0, decode));
+        threads.push_back(runHop(1, enrich));
+        threads.push_back(runHop(2, risk));
+        threads.push_back(runHop(3, [&lat, &accepted](Order& order) {
+            accepted += order.accepted_;
+            lat.record(rdtscp() - order.tsc_);
+        }));
+
+        pinRole(0, roles);
+        for (uint64_t i = 0; i < msgs; ++i) {
+            queues[0]->blockPush([i](Order* order) { produce(*order, i); });
+        }
+    }
+    report("spsc    ", lat, msgs, accepted, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+int main(int argc, char** argv) {
+    const uint64_t msgs = argc > 1 ? std::stoull(argv[1]) : 1'000'000;
+    tscCalibration();
+    placeCpus(roles);
+    runPipeline(msgs);
+    runSpscChain(msgs);
+
+    return 0;
+}
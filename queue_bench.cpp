@@ -0,0 +1,406 @@
+#include "spsc.h"
+#include "spmc.h"
+#include "topology.h"
+#include "wsq.h"
+
+#include <sys/wait.h>
+#include <thread>
+#include <vector>
+
+/**
+ * Parameterized queue benchmark, one CSV row per combination of
+ *   --queues      spsc,spmc,spmc_gated,wsq
+ *   --modes       thread (consumers are threads), shm (queue in shmMap, consumers are forked processes)
+ *   --sizes       message size in bytes, any of 8,16,32,64,128,256,512,1024,2048,4096
+ *   --capacities  queue capacity, any of 256,1024,4096
+ *   --consumers   number of consumers (spsc only runs with 1)
+ *   --placements  a policy from topology.h (same_l3, smt, cross_socket, any) or explicit cores as
+ *                 producer:consumer1:consumer2..., several placements separated by commas
+ *   --rates       producer rate in msgs/s, 0 is unthrottled
+ *   --msgs        messages per run
+ *   --out         csv file, stdout by default
+ * e.g. queue_bench --queues spsc,spmc --sizes 16,64,1024 --consumers 1,2,4 --placements same_l3,cross_socket,2:10:11:12
+ *
+ * Columns: queue,mode,msg_size,capacity,consumers,placement,cpus,rate,msgs,received,dropped,throughput_msgs_s,
+ * p50_ns,p99_ns,p999_ns,p9999_ns,max_ns
+ * received/dropped/latency are summed/merged over consumers; spmc readers may be lapped, which counts as dropped,
+ * spmc_gated readers hold the writer back instead (SPMCQueue reliable mode);
+ * wsq consumers are thieves sharing the messages, wsq is thread mode only (its arrays live on the heap).
+ */
+
+using Sizes = std::index_sequence<8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096>;
+using Capacities = std::integer_sequence<std::uint32_t, 256, 1024, 4096>;
+
+constexpr std::uint32_t MAX_CONSUMERS = 16;
+
+template<std::size_t Size>
+struct BenchMsg {
+    std::uint64_t tsc;
+    char payload[Size - sizeof(std::uint64_t)];
+};
+
+template<>
+struct BenchMsg<8> {
+    std::uint64_t tsc;
+    char payload[0];
+};
+
+struct ConsumerResult {
+    LatencyHistogram lat;
+    std::uint64_t received;
+    std::uint64_t dropped;
+    std::uint64_t end_tsc;
+};
+
+// shared by the producer and the consumers, in shmMap for the shm mode so that forked consumers can report back
+struct Results {
+    std::atomic<std::uint32_t> ready;
+    std::atomic<std::uint32_t> go;
+    std::uint64_t start_tsc;
+    std::array<ConsumerResult, MAX_CONSUMERS> consumers;
+};
+
+struct Case {
+    std::string queue;
+    std::string mode;
+    std::size_t size;
+    std::uint32_t capacity;
+    std::uint32_t consumers;
+    std::string placement;
+    std::vector<int> cpus;
+    std::uint64_t rate;
+    std::uint64_t msgs;
+};
+
+void pinIfAvailable(int cpu) {
+    if (cpu >= 0 && static_cast<unsigned>(cpu) < std::thread::hardware_concurrency()) {
+        pinCpu(cpu);
+    }
+}
+
+int cpuFor(const Case& c, std::uint32_t role) {
+    return c.cpus.empty() ? -1 : c.cpus[role % c.cpus.size()];
+}
+
+template<typename Msg>
+void fill(Msg* msg, std::uint64_t seq) {
+    std::memset(msg->payload, static_cast<int>(seq), sizeof(Msg) - sizeof(std::uint64_t));
+}
+
+template<typename Msg>
+void consume(const Msg* msg) {
+    Msg copy;
+    std::memcpy(&copy, msg, sizeof(Msg));
+    asm volatile("" : : "r"(&copy) : "memory");
+}
+
+// paces the producer at c.rate msgs/s
+struct Pacer {
+    std::uint64_t interval_;
+    std::uint64_t next_;
+
+    explicit Pacer(std::uint64_t rate)
+            : interval_(rate ? static_cast<std::uint64_t>(1e9 / static_cast<double>(rate) / tscCalibration().ns_per_cycle) : 0),
+              next_(rdtsc()) {}
+
+    void wait() {
+        if (!interval_) return;
+        next_ += interval_;
+        while (rdtsc() < next_) {}
+    }
+};
+
+void startProducer(Results& results, std::uint32_t consumers) {
+    while (results.ready.load(std::memory_order_acquire) != consumers) {}
+    results.start_tsc = rdtscp();
+    results.go.store(1, std::memory_order_release);
+}
+
+void waitGo(Results& results) {
+    results.ready.fetch_add(1, std::memory_order_acq_rel);
+    while (!results.go.load(std::memory_order_acquire)) {}
+}
+
+// runs consumer(i) for every consumer as a thread, or as a forked process in shm mode
+template<typename Consumer, typename Producer>
+void runRoles(const Case& c, Consumer consumer, Producer producer) {
+    std::vector<std::jthread> threads;
+    std::vector<pid_t> children;
+    for (std::uint32_t i = 0; i < c.consumers; ++i) {
+        if (c.mode == "shm") {
+            pid_t pid = fork();
+            if (pid == 0) {
+                pinIfAvailable(cpuFor(c, i + 1));
+                consumer(i);
+                _exit(0);
+            }
+            children.push_back(pid);
+        } else {
+            threads.emplace_back([&c, &consumer, i] {
+                pinIfAvailable(cpuFor(c, i + 1));
+                consumer(i);
+            });
+        }
+    }
+    pinIfAvailable(cpuFor(c, 0));
+    producer();
+    threads.clear();
+    for (auto pid: children) {
+        waitpid(pid, nullptr, 0);
+    }
+}
+
+// the queue is either heap allocated or a fresh shmMap segment
+template<typename Q>
+Q* makeQueue(const Case& c) {
+    if (c.mode == "shm") {
+        shm_unlink("queue_bench");
+        return shmMap<Q>("queue_bench");
+    }
+    return new Q();
+}
+
+template<typename Q>
+void freeQueue(const Case& c, Q* queue) {
+    if (c.mode == "shm") {
+        munmap(queue, sizeof(Q));
+        shm_unlink("queue_bench");
+    } else {
+        delete queue;
+    }
+}
+
+template<std::size_t Size, std::uint32_t Cap>
+void runSpsc(const Case& c, Results& results) {
+    using Msg = BenchMsg<Size>;
+    using Q = SPSCQueue<Msg, Cap>;
+    Q* queue = makeQueue<Q>(c);
+    if (!queue) return;
+    runRoles(c,
+             [&](std::uint32_t) {
+                 auto& r = results.consumers[0];
+                 waitGo(results);
+                 for (std::uint64_t i = 0; i < c.msgs; ++i) {
+                     Msg* msg;
+                     while ((msg = queue->front()) == nullptr) {}
+                     const auto now = rdtscp();
+                     r.lat.record(now - std::min<std::uint64_t>(now, msg->tsc));
+                     consume(msg);
+                     queue->pop();
+                 }
+                 r.received = c.msgs;
+                 r.end_tsc = rdtscp();
+             },
+             [&] {
+                 startProducer(results, 1);
+                 Pacer pacer(c.rate);
+                 for (std::uint64_t i = 0; i < c.msgs; ++i) {
+                     queue->blockPush([i](Msg* msg) {
+                         fill(msg, i);
+                         msg->tsc = rdtscp();
+                     });
+                     pacer.wait();
+                 }
+             });
+    freeQueue(c, queue);
+}
+
+// Gated: every consumer is a gated reader of the reliable mode, the writer waits for the slowest one
+template<std::size_t Size, std::uint32_t Cap, bool Gated>
+void runSpmc(const Case& c, Results& results) {
+    using Msg = BenchMsg<Size>;
+    using Q = SPMCQueue<Msg, Cap, BusySpinWait, Gated ? MAX_CONSUMERS : 0>;
+    Q* queue = makeQueue<Q>(c);
+    if (!queue) return;
+    runRoles(c,
+             [&](std::uint32_t id) {
+                 auto& r = results.consumers[id];
+                 typename Q::Reader reader;
+                 if constexpr (Gated) {
+                     reader = queue->getGatedReader();
+                 } else {
+                     reader = queue->getReader();
+                 }
+                 const auto first = reader.next_idx_;
+                 waitGo(results);
+                 Msg msg;
+                 while (static_cast<std::int32_t>(reader.lastSeq() - (first + c.msgs - 1)) < 0) {
+                     auto result = reader.copy(msg);
+                     if (result.status == Q::ReadStatus::Empty) continue;
+                     const auto now = rdtscp();
+                     r.lat.record(now - std::min<std::uint64_t>(now, msg.tsc));
+                     ++r.received;
+                 }
+                 r.dropped = reader.dropped_;
+                 r.end_tsc = rdtscp();
+                 queue->releaseReader(reader);
+             },
+             [&] {
+                 startProducer(results, c.consumers);
+                 Pacer pacer(c.rate);
+                 for (std::uint64_t i = 0; i < c.msgs; ++i) {
+                     queue->write([i](Msg& msg) {
+                         fill(&msg, i);
+                         msg.tsc = rdtscp();
+                     });
+                     pacer.wait();
+                 }
+             });
+    freeQueue(c, queue);
+}
+
+// the owner pushes slot indices into a slab of Cap messages, thieves steal them and hand the slot back
+template<std::size_t Size, std::uint32_t Cap>
+void runWsq(const Case& c, Results& results) {
+    using Msg = BenchMsg<Size>;
+    WorkStealingQueue<std::uint32_t> queue(Cap);
+    std::vector<Msg> slab(Cap);
+    std::vector<std::atomic<bool>> busy(Cap);
+    std::atomic<std::uint64_t> consumed{0};
+    runRoles(c,
+             [&](std::uint32_t id) {
+                 auto& r = results.consumers[id];
+                 waitGo(results);
+                 while (consumed.load(std::memory_order_relaxed) < c.msgs) {
+                     auto slot = queue.steal();
+                     if (!slot) continue;
+                     const auto now = rdtscp();
+                     r.lat.record(now - std::min<std::uint64_t>(now, slab[*slot].tsc));
+                     consume(&slab[*slot]);
+                     busy[*slot].store(false, std::memory_order_release);
+                     ++r.received;
+                     consumed.fetch_add(1, std::memory_order_relaxed);
+                 }
+                 r.end_tsc = rdtscp();
+             },
+             [&] {
+                 startProducer(results, c.consumers);
+                 Pacer pacer(c.rate);
+                 for (std::uint64_t i = 0; i < c.msgs; ++i) {
+                     const auto slot = static_cast<std::uint32_t>(i & (Cap - 1));
+                     while (busy[slot].load(std::memory_order_acquire)) {}
+                     busy[slot].store(true, std::memory_order_relaxed);
+                     fill(&slab[slot], i);
+                     slab[slot].tsc = rdtscp();
+                     queue.push(slot);
+                     pacer.wait();
+                 }
+             });
+}
+
+template<typename F, std::size_t... Values>
+bool withSize(std::size_t size, F&& f, std::index_sequence<Values...>) {
+    return ((size == Values && (f.template operator()<Values>(), true)) || ...);
+}
+
+template<typename F, std::uint32_t... Values>
+bool withCapacity(std::uint32_t capacity, F&& f, std::integer_sequence<std::uint32_t, Values...>) {
+    return ((capacity == Values && (f.template operator()<Values>(), true)) || ...);
+}
+
+void runCase(const Case& c, std::ostream& csv) {
+    Results* results = c.mode == "shm" ? shmMap<Results>("queue_bench_results") : new Results();
+    if (!results) return;
+    std::memset(static_cast<void*>(results), 0, sizeof(Results));
+
+    const bool found = withSize(c.size, [&]<std::size_t Size>() {
+        withCapacity(c.capacity, [&]<std::uint32_t Cap>() {
+            if (c.queue == "spsc") runSpsc<Size, Cap>(c, *results);
+            if (c.queue == "spmc") runSpmc<Size, Cap, false>(c, *results);
+            if (c.queue == "spmc_gated") runSpmc<Size, Cap, true>(c, *results);
+            if (c.queue == "wsq") runWsq<Size, Cap>(c, *results);
+        }, Capacities{});
+    }, Sizes{});
+
+    LatencyHistogram lat;
+    std::uint64_t received = 0;
+    std::uint64_t dropped = 0;
+    std::uint64_t end_tsc = results->start_tsc;
+    for (std::uint32_t i = 0; i < c.consumers; ++i) {
+        auto& r = results->consumers[i];
+        lat.merge(r.lat);
+        received += r.received;
+        dropped += r.dropped;
+        end_tsc = std::max(end_tsc, r.end_tsc);
+    }
+    const double secs = cyclesToNs(end_tsc - results->start_tsc) / 1e9;
+    auto ns = [&lat](double q) { return static_cast<std::uint64_t>(cyclesToNs(lat.percentile(q))); };
+
+    std::string cpus;
+    for (auto cpu: c.cpus) cpus += (cpus.empty() ? "" : ":") + std::to_string(cpu);
+    if (found) {
+        csv << c.queue << ',' << c.mode << ',' << c.size << ',' << c.capacity << ',' << c.consumers << ','
+            << c.placement << ',' << cpus << ',' << c.rate << ',' << c.msgs << ',' << received << ',' << dropped << ','
+            << static_cast<std::uint64_t>(secs > 0 ? static_cast<double>(received) / secs : 0) << ','
+            << ns(0.5) << ',' << ns(0.99) << ',' << ns(0.999) << ',' << ns(0.9999) << ','
+            << static_cast<std::uint64_t>(cyclesToNs(lat.max_)) << std::endl;
+    } else {
+        std::cerr << "skipping size " << c.size << " capacity " << c.capacity << ": not compiled in" << std::endl;
+    }
+
+    if (c.mode == "shm") {
+        munmap(results, sizeof(Results));
+        shm_unlink("queue_bench_results");
+    } else {
+        delete results;
+    }
+}
+
+std::vector<std::string> split(const std::string& s, char sep) {
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    for (std::string item; std::getline(ss, item, sep);) {
+        if (!item.empty()) out.push_back(item);
+    }
+    return out;
+}
+
+int main(int argc, char** argv) {
+    std::map<std::string, std::string> args{
+            {"queues", "spsc,spmc,spmc_gated,wsq"}, {"modes", "thread"}, {"sizes", "64"}, {"capacities", "1024"},
+            {"consumers", "1"}, {"placements", "same_l3"}, {"rates", "0"}, {"msgs", "1000000"}, {"out", ""}};
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        if (key.rfind("--", 0) != 0 || !args.count(key.substr(2))) {
+            std::cerr << "unknown option " << key << std::endl;
+            return 1;
+        }
+        args[key.substr(2)] = argv[i + 1];
+    }
+
+    std::ofstream file;
+    if (!args["out"].empty()) file.open(args["out"]);
+    std::ostream& csv = args["out"].empty() ? std::cout : file;
+    csv << "queue,mode,msg_size,capacity,consumers,placement,cpus,rate,msgs,received,dropped,throughput_msgs_s,"
+           "p50_ns,p99_ns,p999_ns,p9999_ns,max_ns" << std::endl;
+
+    tscCalibration();
+    for (const auto& queue: split(args["queues"], ','))
+        for (const auto& mode: split(args["modes"], ','))
+            for (const auto& size: split(args["sizes"], ','))
+                for (const auto& capacity: split(args["capacities"], ','))
+                    for (const auto& consumers: split(args["consumers"], ','))
+                        for (const auto& placement: split(args["placements"], ','))
+                            for (const auto& rate: split(args["rates"], ',')) {
+                                Case c{queue, mode, std::stoul(size), static_cast<std::uint32_t>(std::stoul(capacity)),
+                                       static_cast<std::uint32_t>(std::stoul(consumers)), placement, {}, std::stoull(rate),
+                                       std::stoull(args["msgs"])};
+                                if (c.queue == "spsc" && c.consumers != 1) continue;
+                                if (c.consumers == 0 || c.consumers > MAX_CONSUMERS) {
+                                    std::cerr << "consumers must be in [1, " << MAX_CONSUMERS << "]" << std::endl;
+                                    continue;
+                                }
+                                if (c.queue == "wsq" && c.mode == "shm") {
+                                    std::cerr << "wsq only supports the thread mode" << std::endl;
+                                    continue;
+                                }
+                                if (auto policy = parsePlacement(placement)) {
+                                    c.cpus = topology().place(*policy, c.consumers + 1);
+                                } else {
+                                    for (const auto& cpu: split(placement, ':')) c.cpus.push_back(std::stoi(cpu));
+                                }
+                                runCase(c, csv);
+                            }
+
+    return 0;
+}
@@ -0,0 +1,102 @@
+// only the segment layout: with QUEUE_TELEMETRY, telemetry.h would create the segment and map it read-write before
+// main(), queue_top maps it read-only itself
+#undef QUEUE_TELEMETRY
+#include "telemetry.h"
+
+#include <csignal>
+#include <map>
+
+/**
+ * queue_top: live view of the queue_telemetry segment written by processes built with QUEUE_TELEMETRY
+ * One row per attached queue (or SPMCQueue reader): totals, and push/pop rates over the last interval.
+ * The segment is only read, the queues don't know we are here.
+ * usage: queue_top [interval_ms] [iterations, 0 = forever]
+ */
+
+struct Sample {
+    std::uint64_t pushes;
+    std::uint64_t pops;
+    std::uint64_t full;
+    std::uint64_t empty;
+    std::uint64_t overruns;
+    std::uint64_t steals;
+    std::uint64_t steals_lost;
+};
+
+Sample sample(const TelemetrySlot& slot) {
+    return {slot.producer_.pushes_.load(std::memory_order_relaxed),
+            slot.consumer_.pops_.load(std::memory_order_relaxed),
+            slot.producer_.full_.load(std::memory_order_relaxed),
+            slot.consumer_.empty_.load(std::memory_order_relaxed),
+            slot.consumer_.overruns_.load(std::memory_order_relaxed),
+            slot.thieves_.steals_.load(std::memory_order_relaxed),
+            slot.thieves_.steals_lost_.load(std::memory_order_relaxed)};
+}
+
+const TelemetrySegment* openTelemetry(const char* name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) {
+        std::cerr << "No telemetry segment " << name << ", is anything built with QUEUE_TELEMETRY running?"
+                  << std::endl;
+        return nullptr;
+    }
+    void* ptr = mmap(nullptr, sizeof(TelemetrySegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        std::cerr << "Failed to map telemetry segment " << name << ": " << strerror(errno) << std::endl;
+        return nullptr;
+    }
+    const auto* segment = static_cast<const TelemetrySegment*>(ptr);
+    if (segment->magic_.load(std::memory_order_acquire) != TELEMETRY_MAGIC ||
+        segment->version_ != TELEMETRY_VERSION || segment->slot_cnt_ != TELEMETRY_SLOTS) {
+        std::cerr << "Refusing telemetry segment " << name << ": layout mismatch" << std::endl;
+        return nullptr;
+    }
+    return segment;
+}
+
+int main(int argc, char** argv) {
+    const auto interval_ms = argc > 1 ? std::stoul(argv[1]) : 1000;
+    const auto iterations = argc > 2 ? std::stoul(argv[2]) : 0;
+    const auto* segment = openTelemetry("queue_telemetry");
+    if (!segment) {
+        return 1;
+    }
+
+    std::map<std::uint32_t, Sample> last;  // by slot
+    const double secs = static_cast<double>(interval_ms) / 1000;
+    auto rate = [secs](std::uint64_t now, std::uint64_t before) {
+        return static_cast<std::uint64_t>(static_cast<double>(now - before) / secs);
+    };
+    for (unsigned long it = 0; iterations == 0 || it < iterations; ++it) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+        if (iterations != 1) std::cout << "\033[H\033[2J";
+        std::cout << std::left << std::setw(24) << "name" << std::setw(8) << "kind" << std::right << std::setw(8)
+                  << "pid" << std::setw(14) << "pushes" << std::setw(12) << "push/s" << std::setw(14) << "pops"
+                  << std::setw(12) << "pop/s" << std::setw(12) << "full" << std::setw(14) << "empty" << std::setw(8)
+                  << "high" << std::setw(10) << "overruns" << std::setw(8) << "resizes" << std::setw(12) << "steals"
+                  << std::setw(10) << "lost" << "\n";
+        for (std::uint32_t i = 0; i < TELEMETRY_SLOTS; ++i) {
+            const auto& slot = segment->slots_[i];
+            if (slot.state_.load(std::memory_order_acquire) != TelemetrySlot::Active) {
+                last.erase(i);
+                continue;
+            }
+            const auto now = sample(slot);
+            const auto before = last.count(i) ? last[i] : now;
+            last[i] = now;
+            const bool alive = telemetryOwnerAlive(slot);
+            std::cout << std::left << std::setw(24) << slot.name_ << std::setw(8) << telemetryKindName(slot.kind_)
+                      << std::right << std::setw(7) << slot.pid_ << (alive ? " " : "x") << std::setw(14) << now.pushes
+                      << std::setw(12) << rate(now.pushes, before.pushes) << std::setw(14) << now.pops
+                      << std::setw(12) << rate(now.pops, before.pops) << std::setw(12) << now.full << std::setw(14)
+                      << now.empty << std::setw(8) << slot.producer_.high_water_.load(std::memory_order_relaxed)
+                      << std::setw(10) << now.overruns << std::setw(8)
+                      << slot.producer_.resizes_.load(std::memory_order_relaxed) << std::setw(12) << now.steals
+                      << std::setw(10) << now.steals_lost << "\n";
+        }
+        std::cout << "(x: the creating process is gone, the slot is reused once the segment is full)" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include "spsc.h"
+#include "topology.h"
+
+/**
+ * Cost of page faults and TLB misses on the hot path for the different shmMap options
+ * a fresh 4MB ring is mapped for every option set, then each message is pushed and popped right away:
+ * the first lap touches every page for the first time (startup), the second lap is the steady state
+ */
+
+using BigQueue = SPSCQueue<SampleMsg, 65536>;
+const char* shm_name = "shm_map_bench";
+
+void run(const char* name, const ShmOptions& options) {
+    shm_unlink(shm_name);
+    unlink((std::string(options.hugetlbfs_dir) + "/" + shm_name).c_str());
+
+    ShmReport report;
+    auto* queue = shmMap<BigQueue>(shm_name, options, &report);
+    if (!queue) {
+        return;
+    }
+    std::cout << name << " " << report << std::endl;
+
+    LatencyHistogram startup;
+    LatencyHistogram steady;
+    for (int lap = 0; lap < 2; ++lap) {
+        auto& lat = lap == 0 ? startup : steady;
+        for (int i = 0; i < 65536; ++i) {
+            auto t1 = rdtscp();
+            queue->blockPush([t1](SampleMsg* msg) {
+                msg->timestamp = t1;
+                msg->buffer[0] = 'x';
+            });
+            queue->tryPop([](SampleMsg* msg) { asm volatile("" : : "r"(msg->buffer[0])); });
+            lat.record(rdtscp() - t1);
+        }
+    }
+    startup.print(std::cout, "  startup");
+    steady.print(std::cout, "  steady ");
+
+    munmap(queue, report.mapped_size);
+    shm_unlink(shm_name);
+    unlink((std::string(options.hugetlbfs_dir) + "/" + shm_name).c_str());
+}
+
+int main() {
+    if (!pinRole(0, 1)) {
+        return 1;
+    }
+    tscCalibration();
+    run("plain                ", ShmOptions{});
+    run("populate             ", ShmOptions{.populate = true});
+    run("populate+lock        ", ShmOptions{.populate = true, .lock = true});
+    run("huge+populate+lock   ", ShmOptions{.huge_pages = true, .populate = true, .lock = true});
+
+    return 0;
+}
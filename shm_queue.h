@@ -0,0 +1,242 @@
+#ifndef CONCURRENCY_SHM_QUEUE_H
+#define CONCURRENCY_SHM_QUEUE_H
+
+#include "shm_segment.h"
+
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * Runtime-sized versions of SPSCQueue and SPMCQueue living in a self-describing segment (see shm_segment.h)
+ * - create(name, capacity) sizes the segment, attach(name) takes the capacity from the header. An existing segment
+ *   is attached to, create(name, capacity, ShmCreate::Recreate) replaces it instead while no receiver is attached
+ * - the handle is process-local and caches the mask, so indexing is still a single AND like the compile-time version
+ * - senders and receivers built with a different message type or layout refuse to attach instead of corrupting
+ *   each other
+ * Segment layout: [ShmSegmentHeader][Control][slots...], every part cache line aligned
+ */
+
+inline constexpr std::size_t cacheAlign(std::size_t n) {
+    return (n + 63) & ~std::size_t{63};
+}
+
+template<typename T>
+struct ShmSPSCQueue {
+    static_assert(std::is_trivially_copyable_v<T>, "T lives in shared memory and is never constructed");
+
+    struct Control {
+        alignas(64) std::atomic<std::uint64_t> write_idx_;
+        alignas(64) std::uint64_t read_idx_cache_;
+        alignas(64) std::atomic<std::uint64_t> read_idx_;
+    };
+
+    static constexpr std::size_t CONTROL_OFFSET = cacheAlign(sizeof(ShmSegmentHeader));
+    static constexpr std::size_t DATA_OFFSET = cacheAlign(CONTROL_OFFSET + sizeof(Control));
+
+    ShmSegment segment_;
+    Control* ctrl_{nullptr};
+    T* data_{nullptr};
+    std::uint64_t mask_{0};
+
+    static std::size_t segmentSize(std::uint64_t capacity) {
+        return DATA_OFFSET + capacity * sizeof(T);
+    }
+
+    static ShmSPSCQueue create(const char* name, std::uint64_t capacity, ShmCreate mode = ShmCreate::Attach) {
+        return ShmSPSCQueue(shmCreateSegment(name, ShmQueueKind::SPSC, typeHash<T>(), sizeof(T), capacity,
+                                             segmentSize(capacity), mode));
+    }
+
+    static ShmSPSCQueue attach(const char* name) {
+        return ShmSPSCQueue(shmAttachSegment(name, ShmQueueKind::SPSC, typeHash<T>(), sizeof(T)));
+    }
+
+    explicit ShmSPSCQueue(ShmSegment segment) : segment_(std::move(segment)) {
+        if (segment_) {
+            ctrl_ = reinterpret_cast<Control*>(segment_.at(CONTROL_OFFSET));
+            data_ = reinterpret_cast<T*>(segment_.at(DATA_OFFSET));
+            mask_ = segment_.header()->capacity_ - 1;
+        }
+    }
+
+    [[nodiscard]] std::uint64_t capacity() const { return mask_ + 1; }
+
+    explicit operator bool() const { return ctrl_; }
+
+    T* alloc() {
+        const auto write_idx = ctrl_->write_idx_.load(std::memory_order_relaxed);
+        if (write_idx - ctrl_->read_idx_cache_ > mask_) {
+            ctrl_->read_idx_cache_ = ctrl_->read_idx_.load(std::memory_order_acquire);
+            if (__builtin_expect(write_idx - ctrl_->read_idx_cache_ > mask_, 0)) {
+                return nullptr;
+            }
+        }
+        return &data_[write_idx & mask_];
+    }
+
+    void push() {
+        ctrl_->write_idx_.store(ctrl_->write_idx_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    template<typename Writer>
+    bool tryPush(Writer writer) {
+        T* p = alloc();
+        if (!p) return false;
+        writer(p);
+        push();
+        return true;
+    }
+
+    template<typename Writer>
+    void blockPush(Writer writer) {
+        while (!tryPush(writer)) {}
+    }
+
+    T* front() {
+        auto read_idx = ctrl_->read_idx_.load(std::memory_order_relaxed);
+        auto write_idx = ctrl_->write_idx_.load(std::memory_order_acquire);
+        if (read_idx == write_idx) {
+            return nullptr;
+        }
+        return &data_[read_idx & mask_];
+    }
+
+    void pop() {
+        ctrl_->read_idx_.store(ctrl_->read_idx_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    template<typename Reader>
+    bool tryPop(Reader reader) {
+        T* p = front();
+        if (!p) return false;
+        reader(p);
+        pop();
+        return true;
+    }
+};
+
+template<typename T>
+struct ShmSPMCQueue {
+    static_assert(std::is_trivially_copyable_v<T>, "T lives in shared memory and is never constructed");
+
+    struct alignas(64) Block {
+        std::atomic<std::uint32_t> idx_;
+        T data;
+    };
+
+    struct Control {
+        alignas(64) std::atomic<std::uint32_t> write_idx_;
+    };
+
+    static constexpr std::size_t CONTROL_OFFSET = cacheAlign(sizeof(ShmSegmentHeader));
+    static constexpr std::size_t DATA_OFFSET = cacheAlign(CONTROL_OFFSET + sizeof(Control));
+
+    // same semantics as SPMCQueue::Reader
+    struct Reader {
+        ShmSPMCQueue* queue_{nullptr};
+        std::uint32_t next_idx_{};
+        std::uint64_t dropped_{0};
+
+        Reader(ShmSPMCQueue* queue, std::uint32_t next_idx) : queue_(queue), next_idx_(next_idx) {}
+
+        T* read() {
+            auto& block = queue_->blocks_[next_idx_ & queue_->mask_];
+            auto new_idx = block.idx_.load(std::memory_order_acquire);
+            if (static_cast<std::int32_t>(new_idx - next_idx_) < 0) {
+                return nullptr;
+            }
+            next_idx_ = new_idx + 1;
+            return &block.data;
+        }
+
+        T* readLast() {
+            T* ret = nullptr;
+            while (auto p = read()) {
+                ret = p;
+            }
+            return ret;
+        }
+
+        // seqlock-validated copy-out, returns false if there is nothing new, overrun = messages lost before it
+        bool copy(T& out, std::uint32_t& overrun) {
+            overrun = 0;
+            while (true) {
+                auto& block = queue_->blocks_[next_idx_ & queue_->mask_];
+                auto seq = block.idx_.load(std::memory_order_acquire);
+                if (static_cast<std::int32_t>(seq - next_idx_) < 0) {
+                    return false;
+                }
+                if (seq == next_idx_) {
+                    std::memcpy(&out, &block.data, sizeof(T));
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (queue_->ctrl_->write_idx_.load(std::memory_order_relaxed) - next_idx_ <= queue_->mask_) {
+                        ++next_idx_;
+                        return true;
+                    }
+                }
+                auto oldest = queue_->ctrl_->write_idx_.load(std::memory_order_acquire) - queue_->mask_;
+                overrun += oldest - next_idx_;
+                dropped_ += oldest - next_idx_;
+                next_idx_ = oldest;
+            }
+        }
+
+        [[nodiscard]] std::uint32_t lastSeq() const { return next_idx_ - 1; }
+
+        explicit operator bool() const { return queue_; }
+    };
+
+    ShmSegment segment_;
+    Control* ctrl_{nullptr};
+    Block* blocks_{nullptr};
+    std::uint32_t mask_{0};
+
+    static std::size_t segmentSize(std::uint64_t capacity) {
+        return DATA_OFFSET + capacity * sizeof(Block);
+    }
+
+    // sequence numbers are 32-bit and compared as signed distances, so at most 2^31 blocks
+    static ShmSPMCQueue create(const char* name, std::uint64_t capacity, ShmCreate mode = ShmCreate::Attach) {
+        if (capacity > (std::uint64_t{1} << 31)) {
+            std::cerr << "SPMC capacity must be at most 2^31" << std::endl;
+            return ShmSPMCQueue(ShmSegment{});
+        }
+        return ShmSPMCQueue(shmCreateSegment(name, ShmQueueKind::SPMC, typeHash<T>(), sizeof(Block), capacity,
+                                             segmentSize(capacity), mode));
+    }
+
+    static ShmSPMCQueue attach(const char* name) {
+        return ShmSPMCQueue(shmAttachSegment(name, ShmQueueKind::SPMC, typeHash<T>(), sizeof(Block)));
+    }
+
+    explicit ShmSPMCQueue(ShmSegment segment) : segment_(std::move(segment)) {
+        if (segment_) {
+            ctrl_ = reinterpret_cast<Control*>(segment_.at(CONTROL_OFFSET));
+            blocks_ = reinterpret_cast<Block*>(segment_.at(DATA_OFFSET));
+            mask_ = static_cast<std::uint32_t>(segment_.header()->capacity_ - 1);
+        }
+    }
+
+    [[nodiscard]] std::uint64_t capacity() const { return std::uint64_t{mask_} + 1; }
+
+    explicit operator bool() const { return ctrl_; }
+
+    // joins at the next message, readers may join at any time
+    // the Reader points to this handle, so don't move the handle while it has readers
+    Reader getReader() {
+        return Reader(this, ctrl_->write_idx_.load(std::memory_order_acquire) + 1);
+    }
+
+    template<typename Writer>
+    void write(Writer writer) {
+        const auto write_idx = ctrl_->write_idx_.load(std::memory_order_relaxed) + 1;
+        ctrl_->write_idx_.store(write_idx, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        auto& block = blocks_[write_idx & mask_];
+        writer(block.data);
+        block.idx_.store(write_idx, std::memory_order_release);
+    }
+};
+
+#endif //CONCURRENCY_SHM_QUEUE_H
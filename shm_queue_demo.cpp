@@ -0,0 +1,51 @@
+#include "shm_queue.h"
+
+/**
+ * usage:
+ *   shm_queue_demo send <capacity> [attach]   creates the segment with the given capacity, replacing an old one
+ *                                            unless a receiver is still attached to it (attach: use an existing
+ *                                            segment as it is, its capacity has to match)
+ *   shm_queue_demo recv                       attaches, the capacity comes from the segment header
+ * the queue depth can be changed per deployment without rebuilding either side
+ */
+
+struct DemoMsg {
+    std::uint64_t timestamp;
+    std::uint64_t idx;
+};
+
+const char* shm_name = "shm_queue_demo";
+
+int main(int argc, char** argv) {
+    const std::string mode = argc > 1 ? argv[1] : "";
+    if (mode == "send") {
+        const std::uint64_t capacity = argc > 2 ? std::stoull(argv[2]) : 1024;
+        const auto create = argc > 3 && std::string(argv[3]) == "attach" ? ShmCreate::Attach : ShmCreate::Recreate;
+        auto queue = ShmSPSCQueue<DemoMsg>::create(shm_name, capacity, create);
+        if (!queue) {
+            return 1;
+        }
+        std::cout << "created, capacity: " << queue.capacity() << std::endl;
+        for (std::uint64_t i = 0;; ++i) {
+            queue.blockPush([i](DemoMsg* msg) {
+                msg->idx = i;
+                msg->timestamp = rdtscp();
+            });
+            usleep(1000);
+        }
+    }
+    if (mode == "recv") {
+        auto queue = ShmSPSCQueue<DemoMsg>::attach(shm_name);
+        if (!queue) {
+            return 1;
+        }
+        std::cout << "attached, capacity: " << queue.capacity() << std::endl;
+        while (true) {
+            queue.tryPop([](DemoMsg* msg) {
+                std::cout << "i: " << msg->idx << " latency: " << rdtscp() - msg->timestamp << " cycles\n";
+            });
+        }
+    }
+    std::cerr << "usage: " << argv[0] << " send <capacity> [attach] | recv" << std::endl;
+    return 1;
+}
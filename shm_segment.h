@@ -0,0 +1,269 @@
+#ifndef CONCURRENCY_SHM_SEGMENT_H
+#define CONCURRENCY_SHM_SEGMENT_H
+
+#include "utils.h"
+
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+
+/**
+ * Self-describing shared memory segment
+ * The creator sizes the segment once and writes a header describing its layout, attachers map it as it is
+ * (no ftruncate) and refuse it unless the header matches what they were built for:
+ * magic, layout version, queue kind, a hash of the message type, the slot size and the total size.
+ * The capacity is read from the header, so it can be chosen per deployment.
+ * Both sides register their pid in the header so that the creating side can recreate the segment with another
+ * layout (ShmCreate::Recreate) once nobody is using the old one.
+ */
+
+static constexpr std::uint64_t SHM_MAGIC = 0x4555455551435049;  // "IPCQUEUE"
+static constexpr std::uint32_t SHM_LAYOUT_VERSION = 2;
+static constexpr std::uint32_t SHM_MAX_ATTACHED = 8;
+
+enum class ShmQueueKind : std::uint32_t {
+    SPSC = 1,
+    SPMC = 2,
+};
+
+struct alignas(64) ShmSegmentHeader {
+    std::atomic<std::uint64_t> magic_;  // stored last by the creator, attachers wait for it
+    std::uint32_t version_;
+    ShmQueueKind kind_;
+    std::uint64_t type_hash_;
+    std::uint64_t capacity_;
+    std::uint64_t slot_size_;
+    std::uint64_t size_;
+    std::atomic<std::int32_t> attached_[SHM_MAX_ATTACHED];  // pids of the attached processes, 0 = free
+};
+
+// what shmCreateSegment() does when the segment already exists
+enum class ShmCreate : std::uint8_t {
+    Attach,    // attach to it, its header has to match (including the capacity)
+    Recreate,  // unlink it and create a new one, refused while a live process is attached to it
+};
+
+inline bool shmPidAlive(std::int32_t pid) {
+    return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+// a live process attached to the segment, 0 if there is none
+inline std::int32_t shmAttachedPid(const ShmSegmentHeader* header) {
+    for (const auto& attached: header->attached_) {
+        const auto pid = attached.load(std::memory_order_acquire);
+        if (pid && shmPidAlive(pid)) return pid;
+    }
+    return 0;
+}
+
+// FNV-1a over the compiler's spelling of T, its size and its alignment
+template<typename T>
+constexpr std::uint64_t typeHash() {
+    std::uint64_t h = 14695981039346656037ull;
+    auto mix = [&h](std::uint64_t v) {
+        h ^= v;
+        h *= 1099511628211ull;
+    };
+    for (char c: std::string_view(__PRETTY_FUNCTION__)) {
+        mix(static_cast<unsigned char>(c));
+    }
+    mix(sizeof(T));
+    mix(alignof(T));
+    return h;
+}
+
+// owns the mapping of a segment
+struct ShmSegment {
+    void* base_{nullptr};
+    std::size_t size_{0};
+    std::atomic<std::int32_t>* attached_{nullptr};  // our entry in the header
+
+    ShmSegment() = default;
+    ShmSegment(void* base, std::size_t size) : base_(base), size_(size) {}
+    ShmSegment(ShmSegment&& other) noexcept : base_(std::exchange(other.base_, nullptr)),
+                                              size_(std::exchange(other.size_, 0)),
+                                              attached_(std::exchange(other.attached_, nullptr)) {}
+
+    ShmSegment& operator=(ShmSegment&& other) noexcept {
+        std::swap(base_, other.base_);
+        std::swap(size_, other.size_);
+        std::swap(attached_, other.attached_);
+        return *this;
+    }
+
+    ~ShmSegment() {
+        if (attached_) attached_->store(0, std::memory_order_release);
+        if (base_) munmap(base_, size_);
+    }
+
+    // takes an entry in the header's attached_ list, reusing the ones of dead processes
+    bool registerAttached() {
+        const std::int32_t self = getpid();
+        for (auto& attached: header()->attached_) {
+            auto pid = attached.load(std::memory_order_acquire);
+            if ((pid == 0 || !shmPidAlive(pid)) && attached.compare_exchange_strong(pid, self)) {
+                attached_ = &attached;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    [[nodiscard]] ShmSegmentHeader* header() const { return static_cast<ShmSegmentHeader*>(base_); }
+
+    [[nodiscard]] char* at(std::size_t offset) const { return static_cast<char*>(base_) + offset; }
+
+    explicit operator bool() const { return base_; }
+};
+
+/**
+ * Maps an existing segment without truncating it and validates its header.
+ * capacity == 0 accepts any capacity, otherwise it must match.
+ */
+inline ShmSegment shmAttachSegment(const char* name, ShmQueueKind kind, std::uint64_t type_hash,
+                                   std::uint64_t slot_size, std::uint64_t capacity = 0) {
+    int fd = shm_open(name, O_RDWR, 0666);
+    if (fd == -1) {
+        std::cerr << "Failed to open shared memory " << name << ": " << strerror(errno) << std::endl;
+        return {};
+    }
+    // the creator may still be between shm_open and ftruncate
+    struct stat st{};
+    for (int i = 0; i < 1000 && fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) < sizeof(ShmSegmentHeader); ++i) {
+        usleep(1000);
+    }
+    if (static_cast<std::size_t>(st.st_size) < sizeof(ShmSegmentHeader)) {
+        std::cerr << "Shared memory " << name << " is too small to hold a header" << std::endl;
+        close(fd);
+        return {};
+    }
+    const auto size = static_cast<std::size_t>(st.st_size);
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        std::cerr << "Failed to map shared memory " << name << ": " << strerror(errno) << std::endl;
+        return {};
+    }
+    ShmSegment segment(ptr, size);
+    auto* header = segment.header();
+    for (int i = 0; i < 1000 && header->magic_.load(std::memory_order_acquire) != SHM_MAGIC; ++i) {
+        usleep(1000);
+    }
+
+    const char* error = nullptr;
+    if (header->magic_.load(std::memory_order_acquire) != SHM_MAGIC) {
+        error = "bad magic, not a queue segment or never initialized";
+    } else if (header->version_ != SHM_LAYOUT_VERSION) {
+        error = "layout version mismatch";
+    } else if (header->kind_ != kind) {
+        error = "queue kind mismatch";
+    } else if (header->type_hash_ != type_hash) {
+        error = "message type mismatch";
+    } else if (header->slot_size_ != slot_size) {
+        error = "slot size mismatch";
+    } else if (header->size_ != size) {
+        error = "segment size mismatch";
+    } else if (!header->capacity_ || (header->capacity_ & (header->capacity_ - 1))) {
+        error = "capacity is not a power of 2";
+    } else if (capacity && header->capacity_ != capacity) {
+        error = "capacity mismatch";
+    }
+    if (error) {
+        std::cerr << "Refusing shared memory " << name << ": " << error << std::endl;
+        return {};
+    }
+    if (!segment.registerAttached()) {
+        std::cerr << "Shared memory " << name << " has " << SHM_MAX_ATTACHED
+                  << " attached processes already, a recreate won't see this one" << std::endl;
+    }
+    return segment;
+}
+
+/**
+ * Unlinks the segment unless a live process is attached to it. A segment with another layout version (or no valid
+ * header) is unlinked as well, it can't be attached anyway. Returns false and prints why if it is still in use.
+ */
+inline bool shmUnlinkUnused(const char* name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) {
+        return errno == ENOENT;
+    }
+    struct stat st{};
+    std::int32_t pid = 0;
+    if (fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(ShmSegmentHeader)) {
+        void* ptr = mmap(nullptr, sizeof(ShmSegmentHeader), PROT_READ, MAP_SHARED, fd, 0);
+        if (ptr != MAP_FAILED) {
+            const auto* header = static_cast<const ShmSegmentHeader*>(ptr);
+            if (header->magic_.load(std::memory_order_acquire) == SHM_MAGIC &&
+                header->version_ == SHM_LAYOUT_VERSION) {
+                pid = shmAttachedPid(header);
+            }
+            munmap(ptr, sizeof(ShmSegmentHeader));
+        }
+    }
+    close(fd);
+    if (pid) {
+        std::cerr << "Not recreating shared memory " << name << ": process " << pid << " is attached" << std::endl;
+        return false;
+    }
+    shm_unlink(name);
+    return true;
+}
+
+/**
+ * Creates and initializes a segment of the given size. If it already exists it is attached to (then the existing
+ * header has to match, including the capacity), or with ShmCreate::Recreate replaced by a new one as long as no
+ * live process is attached to it: that is how the creating side changes the capacity of a deployment.
+ */
+inline ShmSegment shmCreateSegment(const char* name, ShmQueueKind kind, std::uint64_t type_hash,
+                                   std::uint64_t slot_size, std::uint64_t capacity, std::size_t size,
+                                   ShmCreate mode = ShmCreate::Attach) {
+    if (!capacity || (capacity & (capacity - 1))) {
+        std::cerr << "Capacity must be a power of 2" << std::endl;
+        return {};
+    }
+    // the caller computed size from capacity * slot_size, it has wrapped around if this doesn't hold
+    if (capacity > std::numeric_limits<off_t>::max() / 2 / slot_size) {
+        std::cerr << "Capacity " << capacity << " is too large for shared memory " << name << std::endl;
+        return {};
+    }
+    if (mode == ShmCreate::Recreate && !shmUnlinkUnused(name)) {
+        return {};
+    }
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (fd == -1) {
+        if (errno == EEXIST) {
+            return shmAttachSegment(name, kind, type_hash, slot_size, capacity);
+        }
+        std::cerr << "Failed to open shared memory " << name << ": " << strerror(errno) << std::endl;
+        return {};
+    }
+    if (ftruncate(fd, static_cast<off_t>(size))) {
+        std::cerr << "Failed to truncate shared memory " << name << ": " << strerror(errno) << std::endl;
+        close(fd);
+        return {};
+    }
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        std::cerr << "Failed to map shared memory " << name << ": " << strerror(errno) << std::endl;
+        return {};
+    }
+    ShmSegment segment(ptr, size);
+    auto* header = segment.header();
+    header->version_ = SHM_LAYOUT_VERSION;
+    header->kind_ = kind;
+    header->type_hash_ = type_hash;
+    header->capacity_ = capacity;
+    header->slot_size_ = slot_size;
+    header->size_ = size;
+    header->magic_.store(SHM_MAGIC, std::memory_order_release);
+    if (!segment.registerAttached()) {
+        std::cerr << "Shared memory " << name << ": failed to register the creator" << std::endl;
+    }
+    return segment;
+}
+
+#endif //CONCURRENCY_SHM_SEGMENT_H
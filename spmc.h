@@ -5,9 +5,14 @@
 #ifndef CONCURRENCY_SPMC_H
 #define CONCURRENCY_SPMC_H
 
+#include "payload.h"
+#include "telemetry.h"
 #include "utils.h"
+#include "wait_strategy.h"
 
 #include <atomic>
+#include <cstring>
+#include <type_traits>
 
 /**
  * SPMCQueue
@@ -19,70 +24,346 @@
  *
  * If you want an MPMC, you can create multiple SPMCQueues
  * Otherwise, simply replace ++write_idx with an atomic fetch_add (bad design because producer contention)
+ *
+ * Reliable mode (MaxGating > 0): up to MaxGating readers can register with getGatedReader(), they publish their
+ * cursor and the writer never overwrites a message they haven't read (like the Disruptor's gating sequences).
+ * Readers from getReader() stay best-effort and lossy. The writer keeps the slowest cursor it has seen and only
+ * rescans the cursors when the ring looks full against it, so gating costs one compare per write while readers
+ * keep up. A gated reader that stops reading stalls the writer, release it with releaseReader().
  */
 
-template<typename T, std::uint32_t Cnt>
+// a gated reader's position in the ring, in the queue so that readers in other processes are seen by the writer
+struct alignas(64) SPMCCursor {
+    enum State : std::uint32_t {
+        Free = 0,  // 0 so that a zero-filled shm segment has no readers
+        Joining,
+        Active,
+    };
+
+    std::atomic<std::uint32_t> state_{Free};
+    std::atomic<std::uint32_t> next_idx_{0};  // everything before it has been read
+};
+
+template<std::uint32_t MaxGating>
+struct SPMCGating {
+    std::array<SPMCCursor, MaxGating> cursors_;
+    alignas(64) std::uint32_t min_cursor_{0};  // writer only, slowest cursor at the last scan
+};
+
+template<>
+struct SPMCGating<0> {};
+
+template<typename T, std::uint32_t Cnt, typename Wait = BusySpinWait, std::uint32_t MaxGating = 0>
 struct SPMCQueue {
     static_assert(Cnt && !(Cnt & (Cnt - 1)), "Cnt must be a power of 2");
+    static_assert(Wait::multi_consumer, "Wait strategy does not support multiple readers");
 
     struct alignas(64) Block {
         std::atomic<std::uint32_t> idx_{0};
         T data;
     };
 
+    // result of Reader::copy()
+    enum class ReadStatus : std::uint8_t {
+        Empty,  // nothing new
+        Ok,     // copied the next message, overrun is the number of messages lost right before it
+    };
+
+    struct CopyResult {
+        ReadStatus status;
+        std::uint32_t overrun;
+    };
+
+    // where a reader starts when it joins, see getReader()
+    enum class JoinFrom : std::uint8_t {
+        Next,    // only messages written after joining
+        Latest,  // the most recent message, then everything after it
+        Oldest,  // the oldest message still in the ring
+        Seq,     // a given sequence number, e.g. lastSeq() + 1 saved by a previous run
+    };
+
     struct Reader {
-        SPMCQueue<T, Cnt>* queue_{nullptr};
+        SPMCQueue* queue_{nullptr};
         std::uint32_t next_idx_{};
+        std::uint64_t dropped_{0};  // messages lost since the reader was created
+        SPMCCursor* cursor_{nullptr};  // gated readers only
+        [[no_unique_address]] QueueTelemetry telemetry_;  // a slot per reader, see telemetry.h
+
+        Reader() = default;
+        Reader(SPMCQueue* queue, std::uint32_t next_idx) : queue_(queue), next_idx_(next_idx) {}
 
-        Reader(SPMCQueue<T, Cnt>* queue, std::uint32_t next_idx) : queue_(queue), next_idx_(next_idx) {}
+        bool attachTelemetry(const char* name) { return telemetry_.attach(name, TelemetryKind::SPMCReader); }
 
+        // for a gated reader this also releases the message returned by the previous read()
         T* read() {
+            commit();
             auto& block = queue_->blocks_[next_idx_ & (Cnt - 1)];
             auto new_idx = block.idx_.load(std::memory_order_acquire);
             if (static_cast<int64_t>(new_idx) - static_cast<int64_t>(next_idx_) < 0) {
+                telemetry_.onEmpty();
                 return nullptr;
             }
+            if (new_idx != next_idx_) telemetry_.onOverrun(new_idx - next_idx_);
+            telemetry_.onPop();
             next_idx_ = new_idx + 1;
             return &block.data;
         }
 
+        // blocks according to the queue's Wait strategy until a message is available
+        T* waitRead() {
+            T* p = nullptr;
+            queue_->wait_.wait([&] { return (p = read()) != nullptr; });
+            return p;
+        }
+
+        /**
+         * Copy-out read validated like a seqlock, safe against the writer overwriting the block while copying
+         * - before: block.idx_ must be next_idx_, otherwise it's either empty or we've been lapped
+         * - after: the writer bumps write_idx_ before touching a block, if it has reached next_idx_ + Cnt
+         *   then it may have started overwriting our block and the copy is discarded
+         * When lapped, the reader re-syncs to the oldest message still in the ring and reports how many it lost.
+         * write() pays nothing extra for this, the validation cost is on the reader only.
+         */
+        CopyResult copy(T& out) {
+            static_assert(std::is_trivially_copyable_v<T>, "copy() requires a trivially copyable T");
+            std::uint32_t overrun = 0;
+            while (true) {
+                auto& block = queue_->blocks_[next_idx_ & (Cnt - 1)];
+                auto seq = block.idx_.load(std::memory_order_acquire);
+                if (static_cast<std::int32_t>(seq - next_idx_) < 0) {
+                    telemetry_.onEmpty();
+                    return {ReadStatus::Empty, overrun};
+                }
+                if (seq == next_idx_) {
+                    std::memcpy(&out, &block.data, sizeof(T));
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (__builtin_expect(queue_->write_idx_.load(std::memory_order_relaxed) - next_idx_ < Cnt, 1)) {
+                        ++next_idx_;
+                        commit();
+                        telemetry_.onPop();
+                        return {ReadStatus::Ok, overrun};
+                    }
+                }
+                // lapped (or torn): skip to the oldest message that is still valid
+                auto oldest = queue_->write_idx_.load(std::memory_order_acquire) - Cnt + 1;
+                overrun += oldest - next_idx_;
+                dropped_ += oldest - next_idx_;
+                telemetry_.onOverrun(oldest - next_idx_);
+                next_idx_ = oldest;
+            }
+        }
+
+        /**
+         * The newest message, nullptr if there is nothing new. Jumps straight to write_idx_ - 1 instead of walking
+         * the backlog: that one is complete, write_idx_ itself may still be in progress and is read() once it is
+         * published. The messages jumped over are not counted as lost. Not validated, see copyLast().
+         */
         T* readLast() {
+            const auto write_idx = queue_->write_idx_.load(std::memory_order_acquire);
+            if (static_cast<std::int32_t>(write_idx - 1 - next_idx_) > 0) {
+                next_idx_ = write_idx - 1;
+            }
             T* ret = nullptr;
-            // read until the last available
             while (auto p = read()) {
                 ret = p;
             }
             return ret;
         }
 
+        /**
+         * O(1) conflated read: copies the newest complete message whatever the backlog, validated like copy().
+         * overrun in the result is the number of messages skipped to get there (a reader that keeps up gets 0).
+         * Retries while the writer laps the block being copied.
+         */
+        CopyResult copyLast(T& out) {
+            static_assert(std::is_trivially_copyable_v<T>, "copyLast() requires a trivially copyable T");
+            while (true) {
+                auto seq = queue_->write_idx_.load(std::memory_order_acquire);
+                if (queue_->blocks_[seq & (Cnt - 1)].idx_.load(std::memory_order_acquire) != seq) {
+                    --seq;  // still being written
+                }
+                if (static_cast<std::int32_t>(seq - next_idx_) < 0) {
+                    telemetry_.onEmpty();
+                    return {ReadStatus::Empty, 0};
+                }
+                auto& block = queue_->blocks_[seq & (Cnt - 1)];
+                if (block.idx_.load(std::memory_order_acquire) != seq) {
+                    continue;  // lapped since we loaded write_idx_
+                }
+                std::memcpy(&out, &block.data, sizeof(T));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (__builtin_expect(queue_->write_idx_.load(std::memory_order_relaxed) - seq < Cnt, 1)) {
+                    const auto skipped = seq - next_idx_;
+                    next_idx_ = seq + 1;
+                    commit();
+                    telemetry_.onPop();
+                    return {ReadStatus::Ok, skipped};
+                }
+            }
+        }
+
+        // sequence number of the last message returned by read() or copy()
+        [[nodiscard]] std::uint32_t lastSeq() const { return next_idx_ - 1; }
+
+        // gated readers: hands everything before next_idx_ back to the writer, read() does it on every call
+        void commit() {
+            if constexpr (MaxGating != 0) {
+                if (cursor_ && cursor_->next_idx_.load(std::memory_order_relaxed) != next_idx_) {
+                    cursor_->next_idx_.store(next_idx_, std::memory_order_release);
+                }
+            }
+        }
+
         explicit operator bool() const { return queue_; }
     };
 
     std::array<Block, Cnt> blocks_;
-    alignas(64) std::uint32_t write_idx_;  // does not need to be atomic
+    // only the writer modifies it, atomic so that readers can check how far the writer got (see Reader::copy)
+    alignas(64) std::atomic<std::uint32_t> write_idx_;
+    [[no_unique_address]] Wait wait_;  // shared by all readers, empty for the spinning strategies
+    [[no_unique_address]] SPMCGating<MaxGating> gating_;  // empty unless MaxGating > 0
+    [[no_unique_address]] QueueTelemetry telemetry_;      // the writer's counters, empty unless QUEUE_TELEMETRY
+
+    // every process writing the queue attaches it under the same name, readers attach their own, see telemetry.h
+    bool attachTelemetry(const char* name) { return telemetry_.attach(name, TelemetryKind::SPMC); }
+
+    /**
+     * Readers can join at any time, also from another process attached through shmMap while the writer is running.
+     * The only thing the writer publishes for this is write_idx_, which it updates anyway.
+     * A message is "in the ring" if it has not been overwritten yet, that is seq > write_idx_ - Cnt.
+     * The oldest messages are the next ones to be overwritten, use Reader::copy() to detect that.
+     * When joining from a sequence number that has already been overwritten, the reader starts from the oldest
+     * message instead and the gap is accounted in dropped_.
+     */
+    Reader getReader(JoinFrom from = JoinFrom::Next, std::uint32_t seq = 0) {
+        const auto write_idx = write_idx_.load(std::memory_order_acquire);
+        // sequence numbers start at 1, before the first lap not every block has been written
+        const std::uint32_t oldest = write_idx < Cnt ? 1 : write_idx - Cnt + 1;
+        switch (from) {
+            case JoinFrom::Next:
+                return Reader(this, write_idx + 1);
+            case JoinFrom::Latest:
+                // write_idx may still be in progress, the reader sees it as soon as it's published
+                return Reader(this, write_idx ? write_idx : 1);
+            case JoinFrom::Oldest:
+                return Reader(this, oldest);
+            case JoinFrom::Seq:
+                break;
+        }
+        Reader reader(this, seq);
+        if (static_cast<std::int32_t>(seq - oldest) < 0) {
+            reader.dropped_ = oldest - seq;
+            reader.next_idx_ = oldest;
+        }
+        return reader;
+    }
 
-    // readers should be set up before writers begin writing
-    // does not support dynamic subscription of readers
-    Reader getReader() {
-        return Reader(this, write_idx_ + 1);
+    /**
+     * Registers a reader the writer waits for, joining at the next message.
+     * Returns an invalid Reader if all MaxGating cursors are taken.
+     * Race with a running writer: the writer may have checked the gate against an old scan that doesn't include the
+     * new cursor. Such a scan happened before our fence, so reloading write_idx_ after the fence bounds how far the
+     * writer can go without seeing us, and we start after that.
+     */
+    Reader getGatedReader() {
+        static_assert(MaxGating != 0, "the queue has no gating cursors");
+        for (auto& cursor: gating_.cursors_) {
+            std::uint32_t expected = SPMCCursor::Free;
+            if (!cursor.state_.compare_exchange_strong(expected, SPMCCursor::Joining, std::memory_order_acquire,
+                                                       std::memory_order_relaxed)) {
+                continue;
+            }
+            cursor.next_idx_.store(write_idx_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            cursor.state_.store(SPMCCursor::Active, std::memory_order_release);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const auto next_idx = write_idx_.load(std::memory_order_relaxed) + 1;
+            cursor.next_idx_.store(next_idx, std::memory_order_release);
+            Reader reader(this, next_idx);
+            reader.cursor_ = &cursor;
+            return reader;
+        }
+        return Reader{};
+    }
+
+    void releaseReader(Reader& reader) {
+        if constexpr (MaxGating != 0) {
+            if (reader.cursor_) {
+                reader.cursor_->state_.store(SPMCCursor::Free, std::memory_order_release);
+                reader.cursor_ = nullptr;
+            }
+        }
+        reader.telemetry_.release();
+        reader.queue_ = nullptr;
+    }
+
+    // whether seq can be written without overwriting a message a gated reader still needs
+    bool gateOpen(std::uint32_t seq) {
+        if constexpr (MaxGating == 0) {
+            return true;
+        } else {
+            if (__builtin_expect(seq - gating_.min_cursor_ < Cnt, 1)) {
+                return true;
+            }
+            // pairs with the fence in getGatedReader()
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto min_cursor = seq;
+            for (auto& cursor: gating_.cursors_) {
+                if (cursor.state_.load(std::memory_order_acquire) != SPMCCursor::Active) continue;
+                const auto next_idx = cursor.next_idx_.load(std::memory_order_acquire);
+                if (static_cast<std::int32_t>(next_idx - min_cursor) < 0) min_cursor = next_idx;
+            }
+            gating_.min_cursor_ = min_cursor;
+            return seq - min_cursor < Cnt;
+        }
+    }
+
+    // returns false instead of waiting when a gated reader is a full ring behind
+    template<typename Writer>
+    bool tryWrite(Writer writer) {
+        if (!gateOpen(write_idx_.load(std::memory_order_relaxed) + 1)) {
+            telemetry_.onFull();
+            return false;
+        }
+        write(writer);
+        return true;
     }
 
     // Writer is a function that takes a reference to a block data and writes to it
+    // with gated readers it spins until the slowest of them has made room
     template<typename Writer>
     void write(Writer writer) {
-        ++write_idx_;
-        auto& block = blocks_[write_idx_ & (Cnt - 1)];  // this is equivalent to write_idx_ % Cnt
+        const auto write_idx = write_idx_.load(std::memory_order_relaxed) + 1;
+        if constexpr (MaxGating != 0) {
+            if (!gateOpen(write_idx)) {
+                telemetry_.onFull();
+                while (!gateOpen(write_idx)) {
+                    cpuRelax();
+                }
+            }
+        }
+        write_idx_.store(write_idx, std::memory_order_relaxed);
+        // orders the index bump before the data stores, only a compiler barrier on x86
+        std::atomic_thread_fence(std::memory_order_release);
+        auto& block = blocks_[write_idx & (Cnt - 1)];  // this is equivalent to write_idx % Cnt
         writer(block.data);
-        block.idx_.store(write_idx_, std::memory_order_release);
+        block.idx_.store(write_idx, std::memory_order_release);
+        wait_.notify();
+        telemetry_.onPush(0);
+        if constexpr (prefetch_slots_v<T>) {
+            // the block after this one is ours next, readers still on it are about to be lapped anyway
+            prefetchWrite(&blocks_[(write_idx + 1) & (Cnt - 1)], sizeof(Block));
+        }
     }
 };
 
-struct SampleMsg {
+struct SampleSPMCMsg {
     std::uint64_t tsc;
     std::uint64_t idx;
     std::array<char, 64> data;
 };
 
-using SampleSPMCQueue = SPMCQueue<SampleMsg, 1024>;
+using SampleSPMCQueue = SPMCQueue<SampleSPMCMsg, 1024>;
+// used by spmc_shm_send/recv, readers park on a futex in shared memory between bursts
+using SampleShmSPMCQueue = SPMCQueue<SampleSPMCMsg, 1024, FutexWait<>>;
 
 #endif //CONCURRENCY_SPMC_H
@@ -3,6 +3,7 @@
 //
 
 #include "spmc.h"
+#include "topology.h"
 
 #include <thread>
 #include <vector>
@@ -10,13 +11,17 @@
 const uint64_t max_msg = 10'000;
 SampleSPMCQueue queue_{};
 
-void read_thread(int cpu, std::latch& latch) {
-    if (!pinCpu(cpu)) {
+// role 0 is the producer, roles 1-4 the readers, role 5 the slow reader
+constexpr int roles = 6;
+
+void read_thread(int role, std::latch& latch) {
+    if (!pinRole(role, roles)) {
         exit(1);
     }
     auto reader = queue_.getReader();
     latch.arrive_and_wait();
-    uint64_t total = 0;
+    const auto rdtscp_lat = tscCalibration().rdtscp_overhead;
+    LatencyHistogram lat;
     uint64_t count = 0;
     while (true) {
         auto* msg = reader.read();
@@ -25,29 +30,66 @@ void read_thread(int cpu, std::latch& latch) {
         }
         auto now = rdtscp();
         auto latency = now - msg->tsc;
-        total += latency;
+        lat.record(latency - std::min<uint64_t>(latency, rdtscp_lat));
         ++count;
         if (msg->idx == max_msg - 1) {
-            std::cout << "avg latency: " << total / count << " drop count: " << max_msg - count << std::endl;
+            std::ostringstream os;
+            os << "reader " << role << " drop count: " << max_msg - count << " ";
+            lat.print(os, "latency");
+            std::cout << os.str() << std::flush;
             return;
         }
     }
 }
 
+// a reader that is too slow on purpose, copies messages out and reports how many it lost to overruns
+void slow_read_thread(int role, std::latch& latch) {
+    if (!pinRole(role, roles)) {
+        exit(1);
+    }
+    auto reader = queue_.getReader();
+    latch.arrive_and_wait();
+    SampleSPMCMsg msg{};
+    uint64_t count = 0;
+    uint64_t overruns = 0;
+    while (true) {
+        auto result = reader.copy(msg);
+        if (result.status == SampleSPMCQueue::ReadStatus::Empty) {
+            continue;
+        }
+        ++count;
+        if (result.overrun) {
+            ++overruns;
+        }
+        if (msg.idx == max_msg - 1) {
+            std::cout << "slow reader count: " << count << " overruns: " << overruns
+                      << " dropped: " << reader.dropped_ << std::endl;
+            return;
+        }
+        auto expire = rdtscp() + 50'000;
+        while (rdtscp() < expire) {
+            continue;
+        }
+    }
+}
+
 int main() {
-    std::latch latch(5);
+    tscCalibration();  // calibrate before the threads start
+    placeCpus(roles);   // and read the topology before anything is pinned
+    std::latch latch(6);
     std::vector<std::jthread> reader_threads;
     for (int i = 0; i < 4; ++i) {
-        reader_threads.emplace_back(read_thread, i + 2, std::ref(latch));
+        reader_threads.emplace_back(read_thread, i + 1, std::ref(latch));
     }
+    reader_threads.emplace_back(slow_read_thread, 5, std::ref(latch));
 
-    if (!pinCpu(1)) {
+    if (!pinRole(0, roles)) {
         exit(1);
     }
     latch.arrive_and_wait();
     std::cout << "Producer running\n";
     for (uint64_t i = 0; i < max_msg; ++i) {
-        queue_.write([i](SampleMsg& msg) {
+        queue_.write([i](SampleSPMCMsg& msg) {
             msg.idx = i;
             msg.tsc = rdtscp();
         });
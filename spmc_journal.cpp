@@ -0,0 +1,98 @@
+#include "journal.h"
+#include "spmc.h"
+#include "topology.h"
+
+#include <csignal>
+
+/**
+ * Journal of the spmc_shm stream (spmc_shm_send), see journal.h
+ * usage:
+ *   spmc_journal record <file> [shm name] [next|oldest]  tap the queue until Ctrl-C, on a core of its own
+ *   spmc_journal replay <file> <shm name> [fast|timed] [rate]
+ *                                                        into a fresh queue, e.g. for spmc_shm_recv
+ *   spmc_journal info <file>                             count, duration, gaps and the first/last records
+ */
+
+std::atomic<bool> stop{false};
+
+int record(const std::string& path, const char* shm_name, const std::string& from) {
+    auto* queue = shmMap<SampleShmSPMCQueue>(shm_name);
+    if (!queue) {
+        return 1;
+    }
+    JournalWriter<SampleSPMCMsg> journal;
+    if (!journal.open(path)) {
+        return 1;
+    }
+    std::signal(SIGINT, [](int) { stop.store(true); });
+    std::signal(SIGTERM, [](int) { stop.store(true); });
+    pinRole(1, 2);  // the writer is role 0 in spmc_shm_send's placement
+    using JoinFrom = SampleShmSPMCQueue::JoinFrom;
+    // spmc_shm_send stamps every message with its rdtscp, that is the stream time a timed replay reproduces
+    const auto cnt = recordJournal(*queue, journal, stop, from == "oldest" ? JoinFrom::Oldest : JoinFrom::Next, 256,
+                                   [](const SampleSPMCMsg& msg) { return msg.tsc; });
+    std::cout << "recorded " << cnt << " messages to " << path << std::endl;
+    return 0;
+}
+
+int replay(const std::string& path, const char* shm_name, const std::string& speed, double rate) {
+    JournalReader<SampleSPMCMsg> journal;
+    if (!journal.open(path)) {
+        return 1;
+    }
+    shm_unlink(shm_name);
+    auto* queue = shmMap<SampleShmSPMCQueue>(shm_name);
+    if (!queue) {
+        return 1;
+    }
+    pinRole(0, 2);
+    const auto start = std::chrono::steady_clock::now();
+    const auto cnt = replayJournal(journal, *queue, speed == "timed" ? ReplaySpeed::Timed : ReplaySpeed::Fast, rate);
+    const auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "replayed " << cnt << " messages in " << secs << "s (" << static_cast<std::uint64_t>(cnt / secs)
+              << " msgs/s)" << std::endl;
+    return 0;
+}
+
+int info(const std::string& path) {
+    JournalReader<SampleSPMCMsg> journal;
+    if (!journal.open(path)) {
+        return 1;
+    }
+    const auto cnt = journal.count();
+    std::cout << "records: " << cnt << " stream tsc: "
+              << (journal.header()->tsc_source_ == JournalTsc::Producer ? "producer" : "tap") << std::endl;
+    if (!cnt) return 0;
+    std::uint64_t lost = 0;
+    std::uint64_t gaps = 0;
+    for (std::uint64_t i = 0; i < cnt; ++i) {
+        lost += journal[i].lost_;
+        gaps += journal[i].lost_ != 0;
+    }
+    const auto cycles = journal[cnt - 1].tsc_ - journal[0].tsc_;
+    std::cout << "duration: " << static_cast<double>(cycles) * journal.header()->ns_per_cycle_ / 1e9
+              << "s lost: " << lost << " in " << gaps << " gaps" << std::endl;
+    for (const auto i: {std::uint64_t{0}, cnt - 1}) {
+        const auto& r = journal[i];
+        std::cout << "#" << i << " seq: " << r.seq_ << " idx: " << r.msg_.idx << " tsc: " << r.tsc_
+                  << " tap tsc: " << r.tap_tsc_ << std::endl;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const std::string cmd = argc > 1 ? argv[1] : "";
+    if (cmd == "record" && argc > 2) {
+        return record(argv[2], argc > 3 ? argv[3] : "spmc_shm", argc > 4 ? argv[4] : "next");
+    }
+    if (cmd == "replay" && argc > 3) {
+        return replay(argv[2], argv[3], argc > 4 ? argv[4] : "fast", argc > 5 ? std::stod(argv[5]) : 1.0);
+    }
+    if (cmd == "info" && argc > 2) {
+        return info(argv[2]);
+    }
+    std::cerr << "usage: spmc_journal record <file> [shm name] [next|oldest]\n"
+                 "       spmc_journal replay <file> <shm name> [fast|timed] [rate]\n"
+                 "       spmc_journal info <file>" << std::endl;
+    return 1;
+}
@@ -4,23 +4,43 @@
 
 #include "spmc.h"
 
-int main() {
+// usage: spmc_shm_recv [next|latest|oldest|<seq>], defaults to latest
+// the writer can already be running, readers can join and leave at any time
+int main(int argc, char** argv) {
     const char* shm_name = "spmc_shm";
-    auto* queue = shmMap<SampleSPMCQueue>(shm_name);
+    auto* queue = shmMap<SampleShmSPMCQueue>(shm_name);
     if (!queue) {
         return 1;
     }
-    auto reader = queue->getReader();
-    std::cout << "reader size: " << sizeof(reader) << std::endl;
+    using JoinFrom = SampleShmSPMCQueue::JoinFrom;
+    const std::string from = argc > 1 ? argv[1] : "latest";
+    auto reader = from == "next"     ? queue->getReader(JoinFrom::Next)
+                : from == "latest"   ? queue->getReader(JoinFrom::Latest)
+                : from == "oldest"   ? queue->getReader(JoinFrom::Oldest)
+                : queue->getReader(JoinFrom::Seq, static_cast<std::uint32_t>(std::stoul(from)));
+    reader.attachTelemetry(("spmc_shm/" + std::to_string(getpid())).c_str());
+    std::cout << "reader size: " << sizeof(reader) << " joined at seq: " << reader.next_idx_
+              << " dropped: " << reader.dropped_ << std::endl;
 
+    const auto& tsc = tscCalibration();
+    const auto report_cycles = static_cast<uint64_t>(1e9 / tsc.ns_per_cycle);  // summary once per second
+    auto next_report = rdtscp() + report_cycles;
+    LatencyHistogram lat;
     while (true) {
-        auto* msg = reader.readLast();
-        if (!msg) {
-            continue;
+        // park until the writer publishes, then skip to the last available message
+        auto* msg = reader.waitRead();
+        if (auto* last = reader.readLast()) {
+            msg = last;
         }
         auto now = rdtscp();
         auto latency = now - msg->tsc;
-        std::cout << "i: " << msg->idx << " latency: " << latency << std::endl;
+        lat.record(latency - std::min<uint64_t>(latency, tsc.rdtscp_overhead));
+        if (now >= next_report) {
+            std::cout << "seq: " << reader.lastSeq() << " i: " << msg->idx << " ";
+            lat.print(std::cout, "latency");
+            lat.reset();
+            next_report = now + report_cycles;
+        }
     }
 
-}
\ No newline at end of file
+}
@@ -6,16 +6,17 @@
 
 int main() {
     const char* shm_name = "spmc_shm";
-    auto* queue = shmMap<SampleSPMCQueue>(shm_name);
+    auto* queue = shmMap<SampleShmSPMCQueue>(shm_name);
     if (!queue) {
         return 1;
     }
+    queue->attachTelemetry(shm_name);  // a no-op unless built with QUEUE_TELEMETRY
 
     uint64_t i = 0;
 
     while (true) {
         for (int j = 0; j < 3; ++j) {
-            queue->write([i](SampleMsg& msg) {
+            queue->write([i](SampleSPMCMsg& msg) {
                 msg.idx = i;
                 msg.tsc = rdtscp();
             });
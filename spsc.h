@@ -3,49 +3,110 @@
 //
 #pragma once
 
+#include "payload.h"
+#include "telemetry.h"
 #include "utils.h"
+#include "wait_strategy.h"
 
 #include <array>
 #include <atomic>
 #include <iostream>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 /**
  * SPSC Queue for ITC and IPC (linux)
  * Latency should hover around 50-100ns between two CPU cores on the same node for a 10-200B message.
+ * - trivially copyable T: the slots are a plain array of T, written in place through alloc() -> fill -> push()
+ * - any other T (move-only, owning, small-buffer types): the slots are raw aligned storage, a message is constructed
+ *   in its slot by emplace(args...) and destroyed by pop() / popInto() / consume(), so nothing is default-constructed
+ *   up front and nothing is assigned over a live object. The raw-pointer producer API is not available for these.
  */
 
-template<typename T, std::uint32_t Cnt>
+template<typename T, std::uint32_t Cnt, typename Wait = BusySpinWait>
 struct SPSCQueue {
     // must be a power of 2 to use the modulo trick
     static_assert(Cnt && !(Cnt & (Cnt - 1)), "Cnt must be a power of 2");
 
+    static constexpr bool raw_slots = !std::is_trivially_copyable_v<T>;
+
+    struct alignas(T) RawSlot {
+        unsigned char bytes_[sizeof(T)];
+    };
+
+    using Slots = std::array<std::conditional_t<raw_slots, RawSlot, T>, Cnt>;
+
     // avoid false sharing
 #ifdef __cpp_lib_hardware_interference_size
-    alignas(std::hardware_destructive_interference_size) std::array<T, Cnt> data_;
+    alignas(std::hardware_destructive_interference_size) Slots data_;
     alignas(std::hardware_destructive_interference_size) std::atomic<std::size_t> write_idx_{0};
     alignas(std::hardware_destructive_interference_size) std::size_t read_idx_cache_{0};
     alignas(std::hardware_destructive_interference_size) std::atomic<std::size_t> read_idx_{0};
 #else
-    alignas(128) std::array<T, Cnt> data_{};
+    alignas(128) Slots data_{};
     alignas(128) std::atomic<std::size_t> write_idx_{0};
     alignas(128) std::size_t read_idx_cache_{0};
     alignas(128) std::atomic<std::size_t> read_idx_{0};
 #endif
+    // empty for the spinning strategies
+    [[no_unique_address]] Wait wait_;
+    [[no_unique_address]] QueueTelemetry telemetry_;  // empty unless built with QUEUE_TELEMETRY
 
-    T* alloc() {
+    // every process using the queue attaches it under the same name, see telemetry.h
+    bool attachTelemetry(const char* name) { return telemetry_.attach(name, TelemetryKind::SPSC); }
+
+    ~SPSCQueue() requires std::is_trivially_destructible_v<T> = default;
+
+    // destroys the messages that were never popped
+    ~SPSCQueue() {
+        const auto write_idx = write_idx_.load(std::memory_order_acquire);
+        for (auto i = read_idx_.load(std::memory_order_relaxed); i != write_idx; ++i) {
+            std::destroy_at(slot(i));
+        }
+    }
+
+    // the live message at index idx
+    T* slot(std::size_t idx) {
+        if constexpr (raw_slots) {
+            return std::launder(reinterpret_cast<T*>(data_[idx & (Cnt - 1)].bytes_));
+        } else {
+            return &data_[idx & (Cnt - 1)];  // this is equivalent to idx % Cnt
+        }
+    }
+
+    // storage of the next free slot, nullptr if the queue is full
+    void* reserve() {
         const auto write_idx = write_idx_.load(std::memory_order_relaxed);
         if (write_idx - read_idx_cache_ == Cnt) {
             read_idx_cache_ = read_idx_.load(std::memory_order_acquire);
             if (__builtin_expect(write_idx - read_idx_cache_ == Cnt, 0)) {
                 // expect false that the queue is full
+                telemetry_.onFull();
                 return nullptr;
             }
         }
-        return &data_[write_idx_ & (Cnt - 1)]; // this is equivalent to write_idx_ % Cnt
+        if constexpr (prefetch_slots_v<T>) {
+            // the next slot, once it is free, so we don't pull it away from the consumer
+            if (write_idx + 1 - read_idx_cache_ < Cnt) {
+                prefetchWrite(&data_[(write_idx + 1) & (Cnt - 1)], sizeof(T));
+            }
+        }
+        return &data_[write_idx & (Cnt - 1)];
+    }
+
+    T* alloc() {
+        static_assert(!raw_slots, "alloc() hands out a live T to overwrite, use emplace() for this T");
+        return static_cast<T*>(reserve());
     }
 
     void push() {
-        write_idx_.fetch_add(1, std::memory_order_release);
+        // single producer, a plain store is enough (no locked read-modify-write)
+        const auto write_idx = write_idx_.load(std::memory_order_relaxed) + 1;
+        write_idx_.store(write_idx, std::memory_order_release);
+        wait_.notify();
+        telemetry_.onPush(write_idx - read_idx_cache_);
     }
 
     template<typename Writer>
@@ -62,17 +123,95 @@ struct SPSCQueue {
         while (!tryPush(writer)) {}
     }
 
+    /**
+     * Batched producer API: reserve up to n slots, fill them through writeAt(0..k-1), publish all with pushBatch(k)
+     * the index is only written once per batch, so the cache line of write_idx_ moves once instead of k times
+     */
+    std::size_t allocBatch(std::size_t n) {
+        const auto write_idx = write_idx_.load(std::memory_order_relaxed);
+        if (write_idx + n - read_idx_cache_ > Cnt) {
+            read_idx_cache_ = read_idx_.load(std::memory_order_acquire);
+            if (write_idx - read_idx_cache_ == Cnt) telemetry_.onFull();
+        }
+        return std::min<std::size_t>(n, Cnt - (write_idx - read_idx_cache_));
+    }
+
+    // i-th slot reserved by allocBatch()
+    T* writeAt(std::size_t i) {
+        static_assert(!raw_slots, "writeAt() hands out a live T to overwrite, use emplace() for this T");
+        return slot(write_idx_.load(std::memory_order_relaxed) + i);
+    }
+
+    void pushBatch(std::size_t n) {
+        const auto write_idx = write_idx_.load(std::memory_order_relaxed) + n;
+        write_idx_.store(write_idx, std::memory_order_release);
+        wait_.notify();
+        telemetry_.onPush(write_idx - read_idx_cache_, n);
+    }
+
+    // Writer is called as writer(p, i) for every reserved slot, returns the number of messages pushed
+    template<typename Writer>
+    std::size_t tryPushBatch(std::size_t n, Writer writer) {
+        const auto cnt = allocBatch(n);
+        for (std::size_t i = 0; i < cnt; ++i) {
+            writer(writeAt(i), i);
+        }
+        if (cnt) pushBatch(cnt);
+        return cnt;
+    }
+
+    /**
+     * Constructs the message in its slot from args, returns false if the queue is full (args are left untouched).
+     * Works for any T, for trivially copyable T it is alloc() + placement new + push().
+     */
+    template<typename... Args>
+    bool tryEmplace(Args&&... args) {
+        void* p = reserve();
+        if (!p) return false;
+        ::new (p) T(std::forward<Args>(args)...);
+        push();
+        return true;
+    }
+
+    template<typename... Args>
+    void emplace(Args&&... args) {
+        void* p;
+        while (!(p = reserve())) {}
+        ::new (p) T(std::forward<Args>(args)...);
+        push();
+    }
+
     T* front() {
         auto read_idx = read_idx_.load(std::memory_order_relaxed);
         auto write_idx = write_idx_.load(std::memory_order_acquire);
         if (read_idx == write_idx) {
+            telemetry_.onEmpty();
             return nullptr;
         }
-        return &data_[read_idx & (Cnt - 1)];  // this is equivalent to read_idx % Cnt
+        if constexpr (prefetch_slots_v<T>) {
+            // slot k+1 while the caller works on slot k, only if it is already published
+            if (read_idx + 1 != write_idx) {
+                prefetchRead(&data_[(read_idx + 1) & (Cnt - 1)], sizeof(T));
+            }
+        }
+        return slot(read_idx);
+    }
+
+    // blocks according to the Wait strategy until a message is available
+    T* waitFront() {
+        T* p = nullptr;
+        wait_.wait([&] { return (p = front()) != nullptr; });
+        return p;
     }
 
     void pop() {
-        read_idx_.fetch_add(1, std::memory_order_release);
+        // single consumer, a plain store is enough (no locked read-modify-write)
+        const auto read_idx = read_idx_.load(std::memory_order_relaxed);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            std::destroy_at(slot(read_idx));
+        }
+        read_idx_.store(read_idx + 1, std::memory_order_release);
+        telemetry_.onPop();
     }
 
     template<typename Reader>
@@ -83,6 +222,193 @@ struct SPSCQueue {
         pop();
         return true;
     }
+
+    // moves the front message into out and destroys it in its slot, false if the queue is empty
+    bool popInto(T& out) {
+        T* p = front();
+        if (!p) return false;
+        out = std::move(*p);
+        pop();
+        return true;
+    }
+
+    // consumer(T&&) may move from the message or only look at it, it is destroyed in its slot afterwards
+    template<typename Consumer>
+    bool consume(Consumer consumer) {
+        T* p = front();
+        if (!p) return false;
+        consumer(std::move(*p));
+        pop();
+        return true;
+    }
+
+    /**
+     * Batched consumer API: frontBatch(n) returns how many messages (up to n) are ready, read them through
+     * readAt(0..k-1), then retire them all with a single read_idx_ store in popBatch(k)
+     */
+    std::size_t frontBatch(std::size_t n) {
+        auto read_idx = read_idx_.load(std::memory_order_relaxed);
+        auto write_idx = write_idx_.load(std::memory_order_acquire);
+        if (read_idx == write_idx) telemetry_.onEmpty();
+        return std::min<std::size_t>(n, write_idx - read_idx);
+    }
+
+    // i-th slot made available by frontBatch()
+    T* readAt(std::size_t i) {
+        return slot(read_idx_.load(std::memory_order_relaxed) + i);
+    }
+
+    void popBatch(std::size_t n) {
+        const auto read_idx = read_idx_.load(std::memory_order_relaxed);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            for (std::size_t i = 0; i < n; ++i) std::destroy_at(slot(read_idx + i));
+        }
+        read_idx_.store(read_idx + n, std::memory_order_release);
+        telemetry_.onPop(n);
+    }
+
+    // Reader is called as reader(p, i) for every ready slot, returns the number of messages popped
+    template<typename Reader>
+    std::size_t tryPopBatch(std::size_t n, Reader reader) {
+        const auto cnt = frontBatch(n);
+        for (std::size_t i = 0; i < cnt; ++i) {
+            reader(readAt(i), i);
+        }
+        if (cnt) popBatch(cnt);
+        return cnt;
+    }
+};
+
+/**
+ * SPSCVarQueue: byte-oriented SPSC ring for variable-length messages
+ * - every record is an 8-byte MsgHeader followed by the payload, rounded up to 8 bytes
+ * - small messages are packed densely, e.g. 8 records of 24B share two cache lines instead of eight slots
+ * - if a record does not fit before the end of the ring, a padding header is written and the record starts at 0,
+ *   so a payload is always contiguous and can be used in place (zero-copy)
+ * - a single record can be at most half of the ring (maxMsgSize()), otherwise alloc() fails
+ * Same usage as SPSCQueue: alloc(size) -> fill -> push(), front() -> use -> pop()
+ */
+template<std::uint32_t Bytes, typename Wait = BusySpinWait>
+struct SPSCVarQueue {
+    struct MsgHeader {
+        std::uint32_t size_;  // payload size in bytes
+        std::uint32_t type_;  // free for the user, e.g. a message tag
+
+        char* data() { return reinterpret_cast<char*>(this + 1); }
+    };
+
+    static constexpr std::uint32_t BLK = sizeof(MsgHeader);
+    static constexpr std::uint32_t BLK_CNT = Bytes / BLK;
+    static constexpr std::uint32_t PAD = ~0u;  // size_ of a padding record, skip to the start of the ring
+    static_assert(BLK_CNT && !(BLK_CNT & (BLK_CNT - 1)), "Bytes / 8 must be a power of 2");
+
+    // indices count BLK-sized blocks, not records
+#ifdef __cpp_lib_hardware_interference_size
+    alignas(std::hardware_destructive_interference_size) MsgHeader blk_[BLK_CNT];
+    alignas(std::hardware_destructive_interference_size) std::atomic<std::uint64_t> write_idx_{0};
+    alignas(std::hardware_destructive_interference_size) std::uint64_t read_idx_cache_{0};
+    std::uint64_t write_pending_{0};  // producer only: blocks taken by the last alloc()
+    alignas(std::hardware_destructive_interference_size) std::atomic<std::uint64_t> read_idx_{0};
+    alignas(std::hardware_destructive_interference_size) std::uint64_t write_idx_cache_{0};
+    std::uint64_t read_pending_{0};   // consumer only: blocks covered by the last front()
+#else
+    alignas(128) MsgHeader blk_[BLK_CNT];
+    alignas(128) std::atomic<std::uint64_t> write_idx_{0};
+    alignas(128) std::uint64_t read_idx_cache_{0};
+    std::uint64_t write_pending_{0};
+    alignas(128) std::atomic<std::uint64_t> read_idx_{0};
+    alignas(128) std::uint64_t write_idx_cache_{0};
+    std::uint64_t read_pending_{0};
+#endif
+    [[no_unique_address]] Wait wait_;
+
+    static constexpr std::uint32_t maxMsgSize() {
+        return (BLK_CNT / 2 - 1) * BLK;
+    }
+
+    // returns nullptr if the queue is full or size > maxMsgSize()
+    MsgHeader* alloc(std::uint32_t size) {
+        const std::uint64_t blks = 1 + (static_cast<std::uint64_t>(size) + BLK - 1) / BLK;
+        if (__builtin_expect(blks > BLK_CNT / 2, 0)) {
+            return nullptr;
+        }
+        const auto write_idx = write_idx_.load(std::memory_order_relaxed);
+        const std::uint64_t pos = write_idx & (BLK_CNT - 1);
+        const std::uint64_t pad = pos + blks > BLK_CNT ? BLK_CNT - pos : 0;
+        const std::uint64_t need = pad + blks;
+        if (write_idx + need - read_idx_cache_ > BLK_CNT) {
+            read_idx_cache_ = read_idx_.load(std::memory_order_acquire);
+            if (__builtin_expect(write_idx + need - read_idx_cache_ > BLK_CNT, 0)) {
+                return nullptr;
+            }
+        }
+        if (pad) {
+            // not visible to the consumer until push()
+            blk_[pos].size_ = PAD;
+        }
+        write_pending_ = need;
+        MsgHeader* header = &blk_[(write_idx + pad) & (BLK_CNT - 1)];
+        header->size_ = size;
+        return header;
+    }
+
+    void push() {
+        // single producer, a plain store is enough
+        write_idx_.store(write_idx_.load(std::memory_order_relaxed) + write_pending_, std::memory_order_release);
+        wait_.notify();
+    }
+
+    template<typename Writer>
+    bool tryPush(std::uint32_t size, Writer writer) {
+        MsgHeader* header = alloc(size);
+        if (!header) return false;
+        writer(header);
+        push();
+        return true;
+    }
+
+    template<typename Writer>
+    void blockPush(std::uint32_t size, Writer writer) {
+        while (!tryPush(size, writer)) {}
+    }
+
+    MsgHeader* front() {
+        auto read_idx = read_idx_.load(std::memory_order_relaxed);
+        if (read_idx == write_idx_cache_) {
+            write_idx_cache_ = write_idx_.load(std::memory_order_acquire);
+            if (read_idx == write_idx_cache_) {
+                return nullptr;
+            }
+        }
+        std::uint64_t skip = 0;
+        MsgHeader* header = &blk_[read_idx & (BLK_CNT - 1)];
+        if (header->size_ == PAD) {
+            // padding is always published together with the record that follows it
+            skip = BLK_CNT - (read_idx & (BLK_CNT - 1));
+            header = &blk_[0];
+        }
+        read_pending_ = skip + 1 + (static_cast<std::uint64_t>(header->size_) + BLK - 1) / BLK;
+        return header;
+    }
+
+    MsgHeader* waitFront() {
+        MsgHeader* header = nullptr;
+        wait_.wait([&] { return (header = front()) != nullptr; });
+        return header;
+    }
+
+    void pop() {
+        read_idx_.store(read_idx_.load(std::memory_order_relaxed) + read_pending_, std::memory_order_release);
+    }
+
+    template<typename Reader>
+    bool tryPop(Reader reader) {
+        MsgHeader* header = front();
+        if (!header) return false;
+        reader(header);
+        pop();
+        return true;
+    }
 };
 
 struct SampleMsg {
@@ -95,3 +421,16 @@ using SampleMsgQueue = SPSCQueue<SampleMsg, 8>;
 SampleMsgQueue* getSampleMsgQueue() {
     return shmMap<SampleMsgQueue>("sample_msg_queue");
 }
+
+// payload of a SampleVarQueue record: the timestamp followed by a variable-length, null-terminated string
+struct SampleVarMsg {
+    std::uint64_t timestamp;
+    char buffer[];
+};
+
+// parks the receiver on a futex in shared memory instead of spinning while the sender is idle
+using SampleVarQueue = SPSCVarQueue<4096, FutexWait<>>;
+
+SampleVarQueue* getSampleVarQueue() {
+    return shmMap<SampleVarQueue>("sample_var_queue");
+}
@@ -0,0 +1,65 @@
+#include <array>
+#include <thread>
+#include "spsc.h"
+#include "topology.h"
+
+/**
+ * Throughput of SPSCQueue when the producer publishes and the consumer retires messages in batches
+ * batch size 1 is equivalent to the plain alloc/push and front/pop path
+ */
+
+struct Msg {
+    int32_t val_len_;
+    uint64_t ts_;
+    std::array<long, 4> val_;
+};
+
+using SpscQueue = SPSCQueue<Msg, 1024>;
+SpscQueue queue_{};
+
+const uint64_t loop = 10'000'000;
+
+void sender(std::size_t batch) {
+    if (!pinRole(0, 2)) {
+        exit(1);
+    }
+
+    auto* queue = &queue_;
+    uint64_t g_val = 0;
+    while (g_val < loop) {
+        const auto n = std::min<uint64_t>(batch, loop - g_val);
+        g_val += queue->tryPushBatch(n, [g_val](Msg* msg, std::size_t i) {
+            msg->val_len_ = 1;
+            msg->val_[0] = static_cast<long>(g_val + i + 1);
+        });
+    }
+}
+
+void receiver(std::size_t batch) {
+    if (!pinRole(1, 2)) {
+        exit(1);
+    }
+
+    auto* q = &queue_;
+    uint64_t g_val = 0;
+    uint64_t bad = 0;
+    const auto start = std::chrono::steady_clock::now();
+    while (g_val < loop) {
+        g_val += q->tryPopBatch(batch, [g_val, &bad](Msg* msg, std::size_t i) {
+            bad += msg->val_[0] != static_cast<long>(g_val + i + 1);
+        });
+    }
+    const auto end = std::chrono::steady_clock::now();
+    const double secs = std::chrono::duration<double>(end - start).count();
+    std::cout << "batch: " << batch << " msgs: " << g_val << " throughput: "
+              << static_cast<uint64_t>(g_val / secs) << " msgs/s bad: " << bad << std::endl;
+}
+
+int main() {
+    for (std::size_t batch = 1; batch <= 64; batch *= 2) {
+        std::jthread recv(receiver, batch);
+        std::jthread send(sender, batch);
+    }
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include "spsc.h"
+#include "topology.h"
+
+#include <memory>
+#include <thread>
+
+/**
+ * Move-only messages through SPSCQueue: jobs (a callable and its captures) handed to another thread
+ *   inplace: a small-buffer InplaceJob constructed in its slot by emplace() and run by consume(), no allocation
+ *   heap:    a std::unique_ptr to the job, one allocation by the producer and one free by the consumer per message
+ * Every InplaceJob constructed is counted, the count must be back to 0 once the queues are gone (including the
+ * jobs left in a queue that was destroyed before they were consumed).
+ * usage: spsc_emplace_itc [msgs]
+ */
+
+std::atomic<std::int64_t> live_jobs{0};
+
+// move-only callable stored in place, like a std::function that never allocates
+class InplaceJob {
+public:
+    static constexpr std::size_t CAPACITY = 48;
+
+    template<typename F>
+        requires(!std::is_same_v<std::decay_t<F>, InplaceJob>)
+    explicit InplaceJob(F&& f) {
+        using Fn = std::decay_t<F>;
+        static_assert(sizeof(Fn) <= CAPACITY && alignof(Fn) <= alignof(std::max_align_t), "callable too large");
+        ::new (buf_) Fn(std::forward<F>(f));
+        ops_ = &OPS<Fn>;
+        live_jobs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    InplaceJob(InplaceJob&& other) noexcept : ops_(other.ops_) {
+        ops_->move_(buf_, other.buf_);
+        live_jobs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    InplaceJob(const InplaceJob&) = delete;
+    InplaceJob& operator=(const InplaceJob&) = delete;
+
+    ~InplaceJob() {
+        ops_->destroy_(buf_);
+        live_jobs.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    std::uint64_t operator()() { return ops_->call_(buf_); }
+
+private:
+    struct Ops {
+        std::uint64_t (*call_)(void*);
+        void (*move_)(void* dst, void* src);
+        void (*destroy_)(void*);
+    };
+
+    template<typename Fn>
+    static constexpr Ops OPS{
+            [](void* p) -> std::uint64_t { return (*static_cast<Fn*>(p))(); },
+            [](void* dst, void* src) { ::new (dst) Fn(std::move(*static_cast<Fn*>(src))); },
+            [](void* p) { static_cast<Fn*>(p)->~Fn(); },
+    };
+
+    const Ops* ops_;
+    alignas(std::max_align_t) unsigned char buf_[CAPACITY];
+};
+
+// a job with some state: a move-only handle plus a few words of captures
+auto makeJob(std::uint64_t i) {
+    return [owner = std::unique_ptr<int>(), a = i, b = i * 3, c = i ^ 0x55]() { return a + b + c; };
+}
+
+using Job = decltype(makeJob(0));
+using InplaceQueue = SPSCQueue<InplaceJob, 1024>;
+using HeapQueue = SPSCQueue<std::unique_ptr<Job>, 1024>;
+
+template<typename Queue, typename Produce, typename Consume>
+void run(const char* name, std::uint64_t msgs, Produce produce, Consume consume) {
+    auto queue = std::make_unique<Queue>();
+    std::uint64_t expected = 0;
+    for (std::uint64_t i = 0; i < msgs; ++i) expected += makeJob(i)();
+
+    std::uint64_t sum = 0;
+    const auto start = rdtscp();
+    {
+        std::jthread receiver([&] {
+            pinRole(1, 2);
+            for (std::uint64_t i = 0; i < msgs;) {
+                if (consume(*queue, sum)) ++i;
+            }
+        });
+        pinRole(0, 2);
+        for (std::uint64_t i = 0; i < msgs; ++i) produce(*queue, i);
+    }
+    const auto cycles = rdtscp() - start;
+    std::cout << name << " " << cyclesToNs(cycles) / static_cast<double>(msgs) << " ns/msg"
+              << (sum == expected ? "" : " WRONG SUM") << std::endl;
+}
+
+int main(int argc, char** argv) {
+    const std::uint64_t msgs = argc > 1 ? std::stoull(argv[1]) : 10'000'000;
+    tscCalibration();
+
+    run<InplaceQueue>(
+            "inplace", msgs, [](InplaceQueue& q, std::uint64_t i) { q.emplace(makeJob(i)); },
+            [](InplaceQueue& q, std::uint64_t& sum) { return q.consume([&sum](InplaceJob&& job) { sum += job(); }); });
+    run<HeapQueue>(
+            "heap   ", msgs, [](HeapQueue& q, std::uint64_t i) { q.emplace(std::make_unique<Job>(makeJob(i))); },
+            [](HeapQueue& q, std::uint64_t& sum) {
+                std::unique_ptr<Job> job;
+                if (!q.popInto(job)) return false;
+                sum += (*job)();
+                return true;
+            });
+
+    {
+        // jobs still queued are destroyed with the queue
+        auto queue = std::make_unique<InplaceQueue>();
+        for (std::uint64_t i = 0; i < 100; ++i) queue->emplace(makeJob(i));
+        for (std::uint64_t i = 0; i < 40; ++i) queue->consume([](InplaceJob&&) {});
+    }
+    std::cout << "live jobs: " << live_jobs.load() << std::endl;
+
+    return live_jobs.load() == 0 ? 0 : 1;
+}
@@ -5,6 +5,7 @@
 #include <array>
 #include <thread>
 #include "spsc.h"
+#include "topology.h"
 
 struct Msg {
     int32_t val_len_;
@@ -21,7 +22,7 @@ uint64_t alloc_lat = 0;
 uint64_t push_lat = 0;
 
 void sender() {
-    if (!pinCpu(6)) {
+    if (!pinRole(0, 2)) {
         exit(1);
     }
 
@@ -50,18 +51,15 @@ void sender() {
 }
 
 void receiver() {
-    if (!pinCpu(7)) {
+    if (!pinRole(1, 2)) {
         exit(1);
     }
-    auto before = rdtscp();
-    for (int i = 0; i < 99; i++) rdtscp();
-    auto after = rdtscp();
-    auto rdtscp_lat = (after - before) / 100;
+    const auto rdtscp_lat = tscCalibration().rdtscp_overhead;
 
     auto* q = &queue_;
 
     int cnt = 0;
-    long sum_lat = 0;
+    LatencyHistogram lat;
     int g_val = 0;
     uint64_t front_lat = 0;
     uint64_t pop_lat = 0;
@@ -72,11 +70,11 @@ void receiver() {
         if (!msg) {
             continue;
         }
-        sum_lat += t2 - msg->ts_;
+        lat.record(t2 - msg->ts_ - std::min<uint64_t>(t2 - msg->ts_, rdtscp_lat));
         cnt++;
         for (int i = 0; i < msg->val_len_; i++) {
             ++g_val;
-            assert(msg->val[i] == g_val);
+            assert(msg->val_[i] == g_val);
         }
         auto t3 = rdtscp();
         q->pop();
@@ -85,13 +83,15 @@ void receiver() {
         pop_lat += t4 - t3;
 
     }
-    std::cout << "recv done, val: " << g_val << " rdtscp_lat: " << rdtscp_lat << " avg_lat: " << (sum_lat / cnt)
+    lat.print(std::cout, "latency");
+    std::cout << "recv done, val: " << g_val << " rdtscp_lat: " << rdtscp_lat
               << " alloc_lat: " << (alloc_lat / cnt - rdtscp_lat) << " push_lat: " << (push_lat / cnt - rdtscp_lat)
               << " front_lat: " << (front_lat / cnt - rdtscp_lat) << " pop_lat: " << (pop_lat / cnt - rdtscp_lat)
               << std::endl;
 }
 
 int main() {
+    tscCalibration();  // calibrate before the threads start
     std::jthread recv(receiver);
     std::jthread send(sender);
 
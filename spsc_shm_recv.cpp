@@ -3,20 +3,35 @@
 //
 
 #include "spsc.h"
+#include "topology.h"
 
 int main() {
-    if (!pinCpu(3)) {
+    const int cpu = placeCpu(1, 2);
+    if (!pinCpu(cpu)) {
         std::cerr << "Failed to pin CPU\n";
         return 1;
     }
-    std::cout << "Pinned CPU to 3\n";
-    SampleMsgQueue* queue = getSampleMsgQueue();
-    SampleMsg* msg = nullptr;
+    std::cout << "Pinned CPU to " << cpu << "\n";
+    SampleVarQueue* queue = getSampleVarQueue();
+    if (!queue) {
+        return 1;
+    }
+    SampleVarQueue::MsgHeader* header = nullptr;
+    const auto& tsc = tscCalibration();
+    const auto report_cycles = static_cast<uint64_t>(1e9 / tsc.ns_per_cycle);  // summary once per second
+    auto next_report = rdtscp() + report_cycles;
+    LatencyHistogram lat;
     while (true) {
-        while ((msg = queue->front()) == nullptr) {}
-        auto latency = rdtscp();
-        latency -= msg->timestamp;
-        std::cout << "Latency: " << latency << " cycles\n";
+        header = queue->waitFront();
+        auto now = rdtscp();
+        auto* msg = reinterpret_cast<SampleVarMsg*>(header->data());
+        auto latency = now - msg->timestamp;
+        lat.record(latency - std::min<uint64_t>(latency, tsc.rdtscp_overhead));
         queue->pop();
+        if (now >= next_report) {
+            lat.print(std::cout, "latency");
+            lat.reset();
+            next_report = now + report_cycles;
+        }
     }
-}
\ No newline at end of file
+}
@@ -3,37 +3,53 @@
 //
 
 #include "spsc.h"
+#include "topology.h"
 
 int main() {
-    if (!pinCpu(2)) {
+    // role 0 of the sender/receiver pair, spsc_shm_recv takes role 1
+    const int cpu = placeCpu(0, 2);
+    if (!pinCpu(cpu)) {
         std::cerr << "Failed to pin CPU\n";
         return 1;
     }
-    std::cout << "Pinned CPU to 2\n";
-    SampleMsgQueue* queue = getSampleMsgQueue();
-    SampleMsg* msg = nullptr;
-
+    std::cout << "Pinned CPU to " << cpu << "\n";
+    SampleVarQueue* queue = getSampleVarQueue();
+    if (!queue) {
+        return 1;
+    }
+    SampleVarQueue::MsgHeader* header = nullptr;
+    const char* text = "0123456789012345678901234567890123456789";
 
     // test send message "0123456789012345678901234567890123456789", which is 40 bytes for 1000 times
+    // each record only takes header + timestamp + text, rounded up to 8 bytes
     for (int i = 0; i < 1000; i++) {
-        while ((msg = queue->alloc()) == nullptr) {}
-        std::strcpy(msg->buffer, "0123456789012345678901234567890123456789");
+        const auto size = static_cast<std::uint32_t>(sizeof(SampleVarMsg) + std::strlen(text) + 1);
+        while ((header = queue->alloc(size)) == nullptr) {}
+        auto* msg = reinterpret_cast<SampleVarMsg*>(header->data());
+        std::strcpy(msg->buffer, text);
         msg->timestamp = rdtscp();
         queue->push();
         // sleep for 1ms
         usleep(1000);
     }
 
+    std::string input;
     while (true) {
-        while ((msg = queue->alloc()) == nullptr) {}
         std::cout << "input: " << std::flush;
-        if (std::cin >> msg->buffer) {
-            msg->timestamp = rdtscp();
-            queue->push();
-        } else {
+        if (!(std::cin >> input)) {
             break;
         }
+        const auto size = static_cast<std::uint32_t>(sizeof(SampleVarMsg) + input.size() + 1);
+        if (size > SampleVarQueue::maxMsgSize()) {
+            std::cerr << "Message too large, max: " << SampleVarQueue::maxMsgSize() << " bytes\n";
+            continue;
+        }
+        while ((header = queue->alloc(size)) == nullptr) {}
+        auto* msg = reinterpret_cast<SampleVarMsg*>(header->data());
+        std::memcpy(msg->buffer, input.c_str(), input.size() + 1);
+        msg->timestamp = rdtscp();
+        queue->push();
     }
 
     return 0;
-}
\ No newline at end of file
+}
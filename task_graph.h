@@ -0,0 +1,147 @@
+#ifndef CONCURRENCY_TASK_GRAPH_H
+#define CONCURRENCY_TASK_GRAPH_H
+
+#include "thread_pool.h"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/**
+ * TaskGraph: a DAG of tasks run on a ThreadPool
+ * - every node has an atomic counter of pending dependencies, a finished node decrements its successors' and
+ *   submits the ones that reach zero from its worker, so they land on that worker's own deque and run cache-hot
+ *   (LIFO), idle workers steal the rest
+ * - nodes are the pool's Tasks themselves and are never freed by the pool: run() can be called again and again
+ *   without any allocation, a node re-arms its counter for the next run as soon as it runs
+ * - the graph as a whole is one counter of unfinished nodes, so a node costs one shared atomic on top of the
+ *   per-edge decrements, instead of TaskGroup's increment on submit plus decrement on completion
+ * Build with add()/precede() from one thread, then run() (from any thread, a worker of the pool included: it keeps
+ * executing tasks while it waits). Adding nodes or edges between runs is fine, not during one.
+ */
+
+struct TaskGraph {
+    struct Node : Task {
+        TaskGraph* graph_;
+        std::uint32_t id_;
+        std::function<void()> fn_;
+        std::atomic<std::uint32_t> pending_{0};  // dependencies not finished yet in the current run
+        std::uint32_t deps_{0};
+        std::uint32_t succ_begin_{0};  // successors are succ_[succ_begin_, succ_end_)
+        std::uint32_t succ_end_{0};
+
+        Node(TaskGraph* graph, std::uint32_t id, std::function<void()> fn)
+                : Task{&TaskGraph::runNode, nullptr}, graph_(graph), id_(id), fn_(std::move(fn)) {}
+    };
+
+    ThreadPool& pool_;
+    std::deque<Node> nodes_;  // stable addresses, the pool holds pointers to them
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> edges_;
+    // built by prepare() from edges_
+    std::vector<Node*> succ_;
+    std::vector<Node*> roots_;
+    bool dirty_{false};
+    TaskGroup remaining_;  // nodes not finished yet in the current run
+
+    explicit TaskGraph(ThreadPool& pool) : pool_(pool) {}
+
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+    [[nodiscard]] std::size_t size() const { return nodes_.size(); }
+
+    template<typename F>
+    std::uint32_t add(F&& fn) {
+        const auto id = static_cast<std::uint32_t>(nodes_.size());
+        nodes_.emplace_back(this, id, std::forward<F>(fn));
+        dirty_ = true;
+        return id;
+    }
+
+    // `to` runs after `from` has finished
+    void precede(std::uint32_t from, std::uint32_t to) {
+        edges_.emplace_back(from, to);
+        dirty_ = true;
+    }
+
+    /**
+     * Lays the successors out contiguously (CSR), finds the roots and checks for cycles.
+     * Returns false if the graph has a cycle or an edge to an unknown node. run() calls it after any change.
+     */
+    bool prepare() {
+        const auto n = static_cast<std::uint32_t>(nodes_.size());
+        std::vector<std::uint32_t> out(n + 1, 0);
+        for (auto& node: nodes_) node.deps_ = 0;
+        for (auto [from, to]: edges_) {
+            if (from >= n || to >= n) return false;
+            ++out[from + 1];
+            ++nodes_[to].deps_;
+        }
+        for (std::uint32_t i = 0; i < n; ++i) out[i + 1] += out[i];
+        succ_.assign(edges_.size(), nullptr);
+        for (std::uint32_t i = 0; i < n; ++i) {
+            nodes_[i].succ_begin_ = nodes_[i].succ_end_ = out[i];
+        }
+        for (auto [from, to]: edges_) {
+            succ_[nodes_[from].succ_end_++] = &nodes_[to];
+        }
+        roots_.clear();
+        for (auto& node: nodes_) {
+            node.pending_.store(node.deps_, std::memory_order_relaxed);
+            if (!node.deps_) roots_.push_back(&node);
+        }
+
+        // Kahn's algorithm, every node must be reachable from the roots once its dependencies are
+        std::vector<std::uint32_t> deps(n);
+        std::vector<Node*> ready = roots_;
+        for (std::uint32_t i = 0; i < n; ++i) deps[i] = nodes_[i].deps_;
+        std::uint32_t visited = 0;
+        while (!ready.empty()) {
+            Node* node = ready.back();
+            ready.pop_back();
+            ++visited;
+            for (auto i = node->succ_begin_; i < node->succ_end_; ++i) {
+                Node* succ = succ_[i];
+                if (--deps[succ->id_] == 0) ready.push_back(succ);
+            }
+        }
+        if (visited != n) return false;
+        dirty_ = false;
+        return true;
+    }
+
+    // runs every node once and returns when all have finished, false if prepare() failed
+    bool run() {
+        if (dirty_ && !prepare()) return false;
+        if (nodes_.empty()) return true;
+        remaining_.pending_.store(static_cast<std::uint32_t>(nodes_.size()), std::memory_order_relaxed);
+        for (Node* root: roots_) {
+            pool_.submit(root);
+        }
+        pool_.wait(remaining_);
+        return true;
+    }
+
+    static void runNode(Task* task) {
+        auto* node = static_cast<Node*>(task);
+        TaskGraph* graph = node->graph_;
+        ThreadPool& pool = graph->pool_;
+        node->fn_();
+        // nobody else touches our counter until the next run
+        node->pending_.store(node->deps_, std::memory_order_relaxed);
+        for (auto i = node->succ_begin_; i < node->succ_end_; ++i) {
+            Node* succ = graph->succ_[i];
+            if (succ->pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                pool.submit(succ);
+            }
+        }
+        // the graph may be gone right after the last node is done, don't touch it past this point
+        if (graph->remaining_.pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            pool.done_.notify();
+        }
+    }
+};
+
+#endif //CONCURRENCY_TASK_GRAPH_H
@@ -0,0 +1,109 @@
+#include "task_graph.h"
+
+#include <random>
+
+/**
+ * Scheduling overhead of TaskGraph from 1 worker to all cores, on graphs of tiny tasks
+ * - wide:   a root, `nodes` independent tasks, a sink
+ * - deep:   a chain of `nodes` tasks, no parallelism at all, the cost of one hand-off per task
+ * - random: every task depends on up to 4 random earlier tasks (a layered-ish DAG, like a build graph)
+ * Every task does `work` iterations of a dependent multiply-add. The same graph is run `runs` times (no allocation
+ * after the first run), the overhead per task is the time per task minus the time of the task body run in order
+ * on one thread.
+ * usage: task_graph_bench [nodes] [runs] [work]
+ */
+
+struct Bench {
+    const char* name_;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> edges_;
+    std::uint32_t nodes_;
+};
+
+Bench wideDag(std::uint32_t n) {
+    Bench b{"wide", {}, n + 2};
+    for (std::uint32_t i = 1; i <= n; ++i) {
+        b.edges_.emplace_back(0, i);
+        b.edges_.emplace_back(i, n + 1);
+    }
+    return b;
+}
+
+Bench deepDag(std::uint32_t n) {
+    Bench b{"deep", {}, n};
+    for (std::uint32_t i = 1; i < n; ++i) {
+        b.edges_.emplace_back(i - 1, i);
+    }
+    return b;
+}
+
+Bench randomDag(std::uint32_t n) {
+    Bench b{"random", {}, n};
+    std::mt19937 rng(42);
+    for (std::uint32_t i = 1; i < n; ++i) {
+        const auto deps = rng() % 5;
+        // mostly recent tasks, so the graph has depth as well as width
+        const std::uint32_t window = std::min<std::uint32_t>(i, 256);
+        for (std::uint32_t d = 0; d < deps; ++d) {
+            b.edges_.emplace_back(i - 1 - rng() % window, i);
+        }
+    }
+    return b;
+}
+
+// the task body, results are kept per task so the work can't be optimized away
+inline void spin(std::uint64_t& out, std::uint32_t work) {
+    std::uint64_t x = out;
+    for (std::uint32_t i = 0; i < work; ++i) {
+        x = x * 6364136223846793005ull + 1442695040888963407ull;
+    }
+    out = x;
+}
+
+template<typename F>
+double timeIt(F fn) {
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    const std::uint32_t nodes = argc > 1 ? std::stoul(argv[1]) : 10'000;
+    const std::uint32_t runs = argc > 2 ? std::stoul(argv[2]) : 100;
+    const std::uint32_t work = argc > 3 ? std::stoul(argv[3]) : 0;
+
+    const unsigned cores = std::thread::hardware_concurrency();
+    std::vector<unsigned> worker_cnts;
+    for (unsigned w = 1; w < cores; w *= 2) worker_cnts.push_back(w);
+    worker_cnts.push_back(cores);
+
+    for (const auto& bench: {wideDag(nodes), deepDag(nodes), randomDag(nodes)}) {
+        std::vector<std::uint64_t> results(bench.nodes_);
+        const double seq_ns = timeIt([&] {
+            for (std::uint32_t r = 0; r < runs; ++r) {
+                for (auto& out: results) spin(out, work);
+            }
+        });
+        const double tasks = static_cast<double>(bench.nodes_) * runs;
+        std::cout << bench.name_ << " (" << bench.nodes_ << " tasks, " << bench.edges_.size()
+                  << " edges) sequential: " << seq_ns / tasks << " ns/task" << std::endl;
+
+        for (unsigned workers: worker_cnts) {
+            ThreadPool pool(workers);
+            TaskGraph graph(pool);
+            for (std::uint32_t i = 0; i < bench.nodes_; ++i) {
+                graph.add([&results, i, work] { spin(results[i], work); });
+            }
+            for (auto [from, to]: bench.edges_) {
+                graph.precede(from, to);
+            }
+            graph.run();  // warmup, builds the successor lists
+            const double ns = timeIt([&] {
+                for (std::uint32_t r = 0; r < runs; ++r) graph.run();
+            });
+            std::cout << "  workers: " << workers << " " << ns / tasks << " ns/task, overhead "
+                      << (ns - seq_ns) / tasks << " ns/task, " << ns / runs / 1000 << " us/run" << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,269 @@
+#ifndef CONCURRENCY_TELEMETRY_H
+#define CONCURRENCY_TELEMETRY_H
+
+#include "utils.h"
+
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Queue telemetry: per-queue counters in the "queue_telemetry" shm segment, read by queue_top
+ * - built with -DQUEUE_TELEMETRY (cmake -DQUEUE_TELEMETRY=ON), otherwise QueueTelemetry is an empty member and
+ *   every hook is an empty inline function: the queues compile exactly as before
+ * - a queue takes a slot with attachTelemetry(name); every process using a queue in shared memory attaches it under
+ *   the same name and gets the same slot (the slot number is stored in the queue, the segment is mapped by every
+ *   process at startup)
+ * - the slot goes back to the segment when the last queue (or reader) that attached it is destroyed: every attach()
+ *   of a name takes a reference. Names must be unique per queue, two queues attached under one name share counter
+ *   groups whose bumps are not atomic. Queues that live in shm are never destroyed: their slot, like any slot whose
+ *   owner process is gone, is reclaimed by attach() once there is no free slot left
+ * - each group of counters has a single writer and a cache line of its own: the producer's, the consumer's
+ *   (SPSCQueue, WorkStealingQueue owner) or the reader's (every SPMCQueue::Reader attaches its own slot).
+ *   A bump is a plain load + store, no lock prefix. Steals are the exception, there are many thieves: they use a
+ *   fetch_add next to the CAS on top_ that they pay anyway
+ * - queue_top only loads the counters, a value can be a few events old but is never torn
+ * Builds with and without telemetry must not share a queue in shm, the queue layout differs.
+ */
+
+static constexpr std::uint64_t TELEMETRY_MAGIC = 0x59524d454c455451;  // "QTELEMRY"
+static constexpr std::uint32_t TELEMETRY_VERSION = 2;
+static constexpr std::uint32_t TELEMETRY_SLOTS = 256;
+
+enum class TelemetryKind : std::uint32_t {
+    SPSC = 1,
+    SPMC,        // the writer side of an SPMCQueue
+    SPMCReader,  // one reader of an SPMCQueue
+    WSQ,
+};
+
+inline const char* telemetryKindName(TelemetryKind kind) {
+    switch (kind) {
+        case TelemetryKind::SPSC:
+            return "spsc";
+        case TelemetryKind::SPMC:
+            return "spmc";
+        case TelemetryKind::SPMCReader:
+            return "spmc_rd";
+        case TelemetryKind::WSQ:
+            return "wsq";
+    }
+    return "?";
+}
+
+struct alignas(64) TelemetryProducer {
+    std::atomic<std::uint64_t> pushes_;
+    std::atomic<std::uint64_t> full_;        // failed alloc()s, or writes held back by a gated reader
+    std::atomic<std::uint64_t> high_water_;  // highest occupancy seen on push
+    std::atomic<std::uint64_t> resizes_;
+};
+
+struct alignas(64) TelemetryConsumer {
+    std::atomic<std::uint64_t> pops_;
+    std::atomic<std::uint64_t> empty_;     // polls that found nothing
+    std::atomic<std::uint64_t> overruns_;  // messages an SPMCQueue reader lost to the writer
+};
+
+struct alignas(64) TelemetryThieves {
+    std::atomic<std::uint64_t> steals_;
+    std::atomic<std::uint64_t> steals_lost_;  // lost the race for the item to the owner or another thief
+};
+
+struct TelemetrySlot {
+    enum State : std::uint32_t {
+        Free = 0,
+        Claimed,
+        Active,
+    };
+
+    alignas(64) std::atomic<std::uint32_t> state_;
+    TelemetryKind kind_;
+    std::int32_t pid_;                   // the process that created the slot
+    std::atomic<std::uint32_t> users_;   // attach()es not released yet, the slot is freed by the last release()
+    char name_[48];
+    TelemetryProducer producer_;
+    TelemetryConsumer consumer_;
+    TelemetryThieves thieves_;
+};
+
+struct TelemetrySegment {
+    std::atomic<std::uint64_t> magic_;
+    std::uint32_t version_;
+    std::uint32_t slot_cnt_;
+    TelemetrySlot slots_[TELEMETRY_SLOTS];
+};
+
+// single writer: no locked instruction
+inline void telemetryBump(std::atomic<std::uint64_t>& counter, std::uint64_t n = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// whether the process that created the slot still exists (a pid can be reused, then a dead slot looks alive)
+inline bool telemetryOwnerAlive(const TelemetrySlot& slot) {
+    return kill(slot.pid_, 0) == 0 || errno == EPERM;
+}
+
+inline void telemetryMax(std::atomic<std::uint64_t>& counter, std::uint64_t v) {
+    if (v > counter.load(std::memory_order_relaxed)) counter.store(v, std::memory_order_relaxed);
+}
+
+// maps (creating it if needed) the named segment, nullptr on failure
+inline TelemetrySegment* mapTelemetry(const char* name = "queue_telemetry") {
+    auto* segment = shmMap<TelemetrySegment>(name);
+    if (!segment) return nullptr;
+    std::uint64_t expected = 0;
+    if (segment->magic_.compare_exchange_strong(expected, TELEMETRY_MAGIC)) {
+        segment->version_ = TELEMETRY_VERSION;
+        segment->slot_cnt_ = TELEMETRY_SLOTS;
+    }
+    return segment;
+}
+
+#ifdef QUEUE_TELEMETRY
+
+// mapped once per process before main(), a process-local segment stands in if the shm one can't be mapped
+inline TelemetrySegment* const telemetry_segment = [] {
+    if (auto* segment = mapTelemetry()) return segment;
+    std::cerr << "Queue telemetry is not published" << std::endl;
+    return new TelemetrySegment{};
+}();
+
+// move-only: the slot is released when the owner is destroyed, a copy would release it a second time
+struct alignas(64) QueueTelemetry {
+    std::uint32_t slot_{0};  // slot + 1, 0 when not attached (also in a zero-filled shm segment)
+
+    QueueTelemetry() = default;
+    QueueTelemetry(QueueTelemetry&& other) noexcept : slot_(std::exchange(other.slot_, 0)) {}
+    QueueTelemetry& operator=(QueueTelemetry&& other) noexcept {
+        std::swap(slot_, other.slot_);
+        return *this;
+    }
+
+    ~QueueTelemetry() { release(); }
+
+    /**
+     * Takes the slot named `name`, or a free one, or one whose owner process is gone.
+     * Returns false if the segment is full. Two processes attaching the same new name at the same time may get two
+     * slots.
+     */
+    bool attach(const char* name, TelemetryKind kind) {
+        auto& slots = telemetry_segment->slots_;
+        for (std::uint32_t i = 0; i < TELEMETRY_SLOTS; ++i) {
+            if (slots[i].state_.load(std::memory_order_acquire) == TelemetrySlot::Active && slots[i].kind_ == kind &&
+                std::strncmp(slots[i].name_, name, sizeof(slots[i].name_)) == 0 && addUser(slots[i])) {
+                // a queue in shm outliving its creator: adopt the slot so that it isn't reclaimed under us
+                if (!telemetryOwnerAlive(slots[i])) slots[i].pid_ = getpid();
+                slot_ = i + 1;
+                return true;
+            }
+        }
+        for (auto reclaim: {false, true}) {
+            for (std::uint32_t i = 0; i < TELEMETRY_SLOTS; ++i) {
+                if (claim(slots[i], name, kind, reclaim)) {
+                    slot_ = i + 1;
+                    return true;
+                }
+            }
+        }
+        std::cerr << "No telemetry slot left for " << name << std::endl;
+        return false;
+    }
+
+    // a reference to a slot in use, fails if its last user is releasing it
+    static bool addUser(TelemetrySlot& slot) {
+        auto users = slot.users_.load(std::memory_order_relaxed);
+        while (users) {
+            if (slot.users_.compare_exchange_weak(users, users + 1, std::memory_order_acquire)) return true;
+        }
+        return false;
+    }
+
+    // a Free slot, or with reclaim an Active one whose owner is gone
+    static bool claim(TelemetrySlot& slot, const char* name, TelemetryKind kind, bool reclaim) {
+        std::uint32_t expected = TelemetrySlot::Free;
+        if (reclaim) {
+            if (slot.state_.load(std::memory_order_acquire) != TelemetrySlot::Active || telemetryOwnerAlive(slot)) {
+                return false;
+            }
+            expected = TelemetrySlot::Active;
+        }
+        if (!slot.state_.compare_exchange_strong(expected, TelemetrySlot::Claimed)) return false;
+        slot.kind_ = kind;
+        slot.pid_ = getpid();
+        slot.users_.store(1, std::memory_order_relaxed);
+        std::strncpy(slot.name_, name, sizeof(slot.name_) - 1);
+        slot.name_[sizeof(slot.name_) - 1] = '\0';
+        for (auto* counter: {&slot.producer_.pushes_, &slot.producer_.full_, &slot.producer_.high_water_,
+                             &slot.producer_.resizes_, &slot.consumer_.pops_, &slot.consumer_.empty_,
+                             &slot.consumer_.overruns_, &slot.thieves_.steals_, &slot.thieves_.steals_lost_}) {
+            counter->store(0, std::memory_order_relaxed);
+        }
+        slot.state_.store(TelemetrySlot::Active, std::memory_order_release);
+        return true;
+    }
+
+    // drops our reference, the last one frees the slot
+    void release() {
+        if (slot_) {
+            auto& slot = telemetry_segment->slots_[slot_ - 1];
+            if (slot.users_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                slot.state_.store(TelemetrySlot::Free, std::memory_order_release);
+            }
+            slot_ = 0;
+        }
+    }
+
+    [[nodiscard]] TelemetrySlot* slot() const { return slot_ ? &telemetry_segment->slots_[slot_ - 1] : nullptr; }
+
+    void onPush(std::uint64_t occupancy, std::uint64_t n = 1) {
+        if (auto* s = slot()) {
+            telemetryBump(s->producer_.pushes_, n);
+            telemetryMax(s->producer_.high_water_, occupancy);
+        }
+    }
+
+    void onFull() {
+        if (auto* s = slot()) telemetryBump(s->producer_.full_);
+    }
+
+    void onResize() {
+        if (auto* s = slot()) telemetryBump(s->producer_.resizes_);
+    }
+
+    void onPop(std::uint64_t n = 1) {
+        if (auto* s = slot()) telemetryBump(s->consumer_.pops_, n);
+    }
+
+    void onEmpty() {
+        if (auto* s = slot()) telemetryBump(s->consumer_.empty_);
+    }
+
+    void onOverrun(std::uint64_t n) {
+        if (auto* s = slot()) telemetryBump(s->consumer_.overruns_, n);
+    }
+
+    void onSteal(bool won) {
+        if (auto* s = slot()) {
+            (won ? s->thieves_.steals_ : s->thieves_.steals_lost_).fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+};
+
+#else
+
+struct QueueTelemetry {
+    bool attach(const char*, TelemetryKind) { return false; }
+    void release() {}
+    void onPush(std::uint64_t, std::uint64_t = 1) {}
+    void onFull() {}
+    void onResize() {}
+    void onPop(std::uint64_t = 1) {}
+    void onEmpty() {}
+    void onOverrun(std::uint64_t) {}
+    void onSteal(bool) {}
+};
+
+#endif
+
+#endif //CONCURRENCY_TELEMETRY_H
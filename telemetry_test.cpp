@@ -0,0 +1,82 @@
+#include "spsc.h"
+#include "thread_pool.h"
+
+#include <sys/wait.h>
+
+#include <memory>
+
+/**
+ * Telemetry slots are given back: only built with QUEUE_TELEMETRY, registered with ctest
+ * - more pools than the segment has slots are created and destroyed, every worker queue must get a slot and none
+ *   may be left behind by this process; two live pools get different slots, a shared name is freed by its last user
+ * - as many child processes exit without destroying the queue they attached, the next ones reclaim their slots
+ */
+
+std::uint32_t activeSlots(pid_t pid) {
+    std::uint32_t cnt = 0;
+    for (const auto& slot: telemetry_segment->slots_) {
+        cnt += slot.state_.load(std::memory_order_acquire) == TelemetrySlot::Active && slot.pid_ == pid;
+    }
+    return cnt;
+}
+
+int main() {
+    constexpr unsigned WORKERS = 8;
+    constexpr int ROUNDS = TELEMETRY_SLOTS + 44;
+    int failures = 0;
+
+    for (int round = 0; round < ROUNDS; ++round) {
+        ThreadPool pool(WORKERS, false);
+        for (const auto& worker: pool.workers_) {
+            if (!worker->queue_.telemetry_.slot_) {
+                std::cerr << "round " << round << ": a worker queue has no telemetry slot" << std::endl;
+                ++failures;
+            }
+        }
+        TaskGroup group;
+        std::atomic<int> ran{0};
+        for (int i = 0; i < 16; ++i) pool.submit(group, [&ran] { ran.fetch_add(1); });
+        pool.wait(group);
+        failures += ran.load() != 16;
+    }
+    {
+        // two pools alive at once don't share counters
+        ThreadPool a(2, false);
+        ThreadPool b(2, false);
+        failures += a.workers_[0]->queue_.telemetry_.slot_ == b.workers_[0]->queue_.telemetry_.slot_;
+    }
+    {
+        // a name attached twice is freed by its last user only
+        auto first = std::make_unique<SPSCQueue<std::uint64_t, 64>>();
+        auto second = std::make_unique<SPSCQueue<std::uint64_t, 64>>();
+        first->attachTelemetry("telemetry_test/shared");
+        second->attachTelemetry("telemetry_test/shared");
+        auto* slot = second->telemetry_.slot();
+        failures += first->telemetry_.slot() != slot;
+        first.reset();
+        failures += slot->state_.load() != TelemetrySlot::Active;
+        second.reset();
+        failures += slot->state_.load() != TelemetrySlot::Free;
+    }
+    if (const auto left = activeSlots(getpid())) {
+        std::cerr << left << " slots still taken after the pools are gone" << std::endl;
+        ++failures;
+    }
+
+    for (int child = 0; child < ROUNDS; ++child) {
+        const pid_t pid = fork();
+        if (pid == 0) {
+            auto* queue = new SPSCQueue<std::uint64_t, 64>();  // leaked, its slot stays Active
+            _exit(queue->attachTelemetry(("telemetry_test/" + std::to_string(child)).c_str()) ? 0 : 1);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            std::cerr << "child " << child << " found no telemetry slot" << std::endl;
+            ++failures;
+        }
+    }
+
+    std::cout << (failures ? "FAILED" : "ok") << std::endl;
+    return failures ? 1 : 0;
+}
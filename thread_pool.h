@@ -0,0 +1,210 @@
+#ifndef CONCURRENCY_THREAD_POOL_H
+#define CONCURRENCY_THREAD_POOL_H
+
+#include "topology.h"
+#include "utils.h"
+#include "wait_strategy.h"
+#include "wsq.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Work stealing thread pool
+ * - one WorkStealingQueue per worker, tasks submitted from a worker go to its own deque (cache-hot, LIFO for owner)
+ * - idle workers steal from random victims (FIFO end, the coldest tasks) with exponential backoff,
+ *   then park on a futex until work arrives
+ * - tasks submitted from non-worker threads go through a small injection queue
+ * - wait(group) from a worker keeps running tasks (so recursive fork-join never deadlocks),
+ *   from a non-worker it blocks until the group is done
+ */
+
+struct TaskGroup {
+    std::atomic<std::uint32_t> pending_{0};
+
+    [[nodiscard]] bool done() const { return pending_.load(std::memory_order_acquire) == 0; }
+};
+
+struct Task {
+    void (*run_)(Task*);  // runs and frees the task (TaskGraph nodes are kept for the next run)
+    TaskGroup* group_;
+};
+
+template<typename F>
+struct FnTask : Task {
+    F fn_;
+
+    template<typename U>
+    FnTask(U&& fn, TaskGroup* group) : Task{&FnTask::run, group}, fn_(std::forward<U>(fn)) {}
+
+    static void run(Task* task) {
+        auto* self = static_cast<FnTask*>(task);
+        self->fn_();
+        delete self;
+    }
+};
+
+struct ThreadPool {
+    static constexpr std::uint32_t MAX_BACKOFF_SHIFT = 10;  // up to 1024 pauses between steal rounds
+    static constexpr std::uint32_t STEAL_ROUNDS = 16;       // failed steal rounds before parking
+
+    struct alignas(64) Worker {
+        WorkStealingQueue<Task*> queue_{1024, {}, 1 << 16};  // shrinks back after bursts
+        std::uint64_t rng_;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::jthread> threads_;
+
+    std::mutex inject_mutex_;
+    std::deque<Task*> inject_;
+    alignas(64) std::atomic<std::uint32_t> inject_cnt_{0};
+
+    FutexWait<0> idle_;  // we do our own spinning/backoff before parking
+    FutexWait<> done_;   // non-worker threads blocked in wait(), lives in the pool so a finished group can go away
+    std::atomic<bool> stop_{false};
+
+    static inline thread_local ThreadPool* tls_pool_ = nullptr;
+    static inline thread_local Worker* tls_worker_ = nullptr;
+    static inline std::atomic<std::uint32_t> next_id_{0};  // telemetry names are unique per pool, not per process
+
+    // tasks still queued when the pool is destroyed are not run, wait() for them first
+    // workers are pinned to the cores chosen by placeCpus() (see topology.h), pin = false leaves them to the scheduler
+    explicit ThreadPool(unsigned workers = std::thread::hardware_concurrency(), bool pin = true) {
+        const auto cpus = pin ? placeCpus(workers) : std::vector<int>{};
+        workers_.reserve(workers);
+        const auto name = "pool" + std::to_string(getpid()) + "." + std::to_string(next_id_.fetch_add(1)) + "/w";
+        for (unsigned i = 0; i < workers; ++i) {
+            workers_.push_back(std::make_unique<Worker>());
+            workers_.back()->rng_ = 0x9E3779B97F4A7C15ull * (i + 1);
+            workers_.back()->queue_.attachTelemetry((name + std::to_string(i)).c_str());
+        }
+        for (unsigned i = 0; i < workers; ++i) {
+            threads_.emplace_back([this, i, cpu = cpus.empty() ? -1 : cpus[i]] {
+                if (cpu >= 0) {
+                    pinCpu(cpu);
+                }
+                run(*workers_[i]);
+            });
+        }
+    }
+
+    ~ThreadPool() {
+        stop_.store(true, std::memory_order_release);
+        idle_.notify();
+        threads_.clear();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    [[nodiscard]] std::size_t size() const { return workers_.size(); }
+
+    void submit(Task* task) {
+        if (task->group_) {
+            task->group_->pending_.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (tls_pool_ == this) {
+            tls_worker_->queue_.push(task);
+        } else {
+            std::lock_guard lock(inject_mutex_);
+            inject_.push_back(task);
+            inject_cnt_.fetch_add(1, std::memory_order_release);
+        }
+        idle_.notify();
+    }
+
+    template<typename F>
+    void submit(TaskGroup& group, F&& fn) {
+        submit(new FnTask<std::decay_t<F>>(std::forward<F>(fn), &group));
+    }
+
+    void wait(TaskGroup& group) {
+        if (tls_pool_ == this) {
+            // help instead of blocking, the tasks we wait for may be sitting in our own deque
+            while (!group.done()) {
+                if (Task* task = findTask(*tls_worker_)) {
+                    execute(task);
+                } else {
+                    cpuRelax();
+                }
+            }
+            return;
+        }
+        done_.wait([&group] { return group.done(); });
+    }
+
+    void execute(Task* task) {
+        TaskGroup* group = task->group_;
+        task->run_(task);
+        if (group && group->pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            done_.notify();
+        }
+    }
+
+    Task* findTask(Worker& self) {
+        if (auto task = self.queue_.pop()) {
+            return *task;
+        }
+        // random victim, xorshift64
+        const auto n = workers_.size();
+        for (std::size_t i = 0; i < n; ++i) {
+            self.rng_ ^= self.rng_ << 13;
+            self.rng_ ^= self.rng_ >> 7;
+            self.rng_ ^= self.rng_ << 17;
+            auto& victim = *workers_[self.rng_ % n];
+            if (&victim == &self) continue;
+            if (auto task = victim.queue_.steal()) {
+                return *task;
+            }
+        }
+        if (inject_cnt_.load(std::memory_order_acquire)) {
+            std::lock_guard lock(inject_mutex_);
+            if (!inject_.empty()) {
+                Task* task = inject_.front();
+                inject_.pop_front();
+                inject_cnt_.fetch_sub(1, std::memory_order_relaxed);
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    [[nodiscard]] bool hasWork() const {
+        if (inject_cnt_.load(std::memory_order_acquire)) return true;
+        for (auto& worker: workers_) {
+            if (!worker->queue_.empty()) return true;
+        }
+        return false;
+    }
+
+    void run(Worker& self) {
+        tls_pool_ = this;
+        tls_worker_ = &self;
+        std::uint32_t failed = 0;
+        while (!stop_.load(std::memory_order_acquire)) {
+            if (Task* task = findTask(self)) {
+                execute(task);
+                failed = 0;
+                continue;
+            }
+            if (++failed < STEAL_ROUNDS) {
+                const auto spins = 1u << std::min(failed, MAX_BACKOFF_SHIFT);
+                for (std::uint32_t i = 0; i < spins; ++i) {
+                    cpuRelax();
+                }
+                continue;
+            }
+            idle_.wait([this] { return stop_.load(std::memory_order_acquire) || hasWork(); });
+            failed = 0;
+        }
+        tls_pool_ = nullptr;
+        tls_worker_ = nullptr;
+    }
+};
+
+#endif //CONCURRENCY_THREAD_POOL_H
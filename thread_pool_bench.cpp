@@ -0,0 +1,108 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+/**
+ * Scaling of the work stealing ThreadPool from 1 worker to all cores on
+ * - recursive fib: fine-grained fork-join, stresses push/pop/steal
+ * - parallel quicksort: irregular fork-join
+ * - flat parallel-for: every chunk submitted up front
+ */
+
+const int fib_n = 32;
+const int fib_cutoff = 16;
+const std::size_t sort_size = 4'000'000;
+const std::size_t sort_cutoff = 4096;
+const std::size_t for_size = 64'000'000;
+const std::size_t for_grain = 16'384;
+
+uint64_t fibSeq(int n) {
+    return n < 2 ? n : fibSeq(n - 1) + fibSeq(n - 2);
+}
+
+uint64_t fib(ThreadPool& pool, int n) {
+    if (n < fib_cutoff) return fibSeq(n);
+    uint64_t a = 0;
+    TaskGroup group;
+    pool.submit(group, [&pool, &a, n] { a = fib(pool, n - 1); });
+    uint64_t b = fib(pool, n - 2);
+    pool.wait(group);
+    return a + b;
+}
+
+void quicksort(ThreadPool& pool, int* first, int* last) {
+    if (static_cast<std::size_t>(last - first) < sort_cutoff) {
+        std::sort(first, last);
+        return;
+    }
+    const int pivot = first[(last - first) / 2];
+    int* mid1 = std::partition(first, last, [pivot](int v) { return v < pivot; });
+    int* mid2 = std::partition(mid1, last, [pivot](int v) { return !(pivot < v); });
+    TaskGroup group;
+    pool.submit(group, [&pool, first, mid1] { quicksort(pool, first, mid1); });
+    quicksort(pool, mid2, last);
+    pool.wait(group);
+}
+
+template<typename F>
+void parallelFor(ThreadPool& pool, std::size_t begin, std::size_t end, std::size_t grain, F fn) {
+    TaskGroup group;
+    for (std::size_t i = begin; i < end; i += grain) {
+        pool.submit(group, [fn, i, last = std::min(i + grain, end)] { fn(i, last); });
+    }
+    pool.wait(group);
+}
+
+template<typename F>
+double timeIt(F fn) {
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    const unsigned cores = std::thread::hardware_concurrency();
+    std::vector<unsigned> worker_cnts;
+    for (unsigned w = 1; w < cores; w *= 2) worker_cnts.push_back(w);
+    worker_cnts.push_back(cores);
+
+    std::vector<int> input(sort_size);
+    std::mt19937 rng(42);
+    std::generate(input.begin(), input.end(), [&rng] { return static_cast<int>(rng()); });
+    std::vector<double> values(for_size, 1.0);
+
+    for (unsigned workers: worker_cnts) {
+        ThreadPool pool(workers);
+
+        uint64_t fib_result = 0;
+        TaskGroup fib_group;
+        const double fib_ms = timeIt([&] {
+            pool.submit(fib_group, [&] { fib_result = fib(pool, fib_n); });
+            pool.wait(fib_group);
+        });
+
+        std::vector<int> data = input;
+        TaskGroup sort_group;
+        const double sort_ms = timeIt([&] {
+            pool.submit(sort_group, [&] { quicksort(pool, data.data(), data.data() + data.size()); });
+            pool.wait(sort_group);
+        });
+        assert(std::is_sorted(data.begin(), data.end()));
+
+        std::vector<double> partial((for_size + for_grain - 1) / for_grain);
+        const double for_ms = timeIt([&] {
+            parallelFor(pool, 0, for_size, for_grain, [&](std::size_t first, std::size_t last) {
+                partial[first / for_grain] = std::accumulate(values.begin() + first, values.begin() + last, 0.0);
+            });
+        });
+        const double sum = std::accumulate(partial.begin(), partial.end(), 0.0);
+
+        std::cout << "workers: " << workers << " fib(" << fib_n << ") = " << fib_result << " " << fib_ms
+                  << "ms, quicksort(" << sort_size << ") " << sort_ms << "ms, parallel_for(" << for_size
+                  << ") sum = " << sum << " " << for_ms << "ms" << std::endl;
+    }
+
+    return 0;
+}
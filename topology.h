@@ -0,0 +1,349 @@
+#ifndef CONCURRENCY_TOPOLOGY_H
+#define CONCURRENCY_TOPOLOGY_H
+
+#include "utils.h"
+
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * CPU topology from /sys/devices/system/cpu and core placement on top of it
+ * Latency between two cores depends on what they share: an SMT sibling shares L1/L2, a core on the same L3 is
+ * the usual 50-100ns case, a core on another socket goes over the interconnect and is several times slower.
+ *
+ * Placement policies, for n cooperating threads/processes (role 0 is the producer by convention):
+ *   same_l3      different physical cores sharing an L3 (default)
+ *   smt          SMT siblings of one physical core
+ *   cross_socket one core per socket, round-robin
+ *   any          different physical cores, anywhere
+ * Isolated cores (isolcpus) are preferred, the physical core of cpu 0 (housekeeping, most IRQs) is used last.
+ * A policy that cannot be met on this machine falls back to the next weaker one with a warning.
+ *
+ * Binaries pick cores with placeCpu(role, roles) / placeCpus(n), configured from the environment:
+ *   IPC_PLACEMENT=same_l3|smt|cross_socket|any
+ *   IPC_CPUS=2,3,6-7   explicit cores, overrides the policy
+ * Processes that don't share memory (e.g. shm sender and receiver) agree on their cores as long as they run with
+ * the same environment, since placement is deterministic.
+ */
+
+enum class Placement {
+    SameL3,
+    SmtSibling,
+    CrossSocket,
+    Any,
+};
+
+inline const char* placementName(Placement placement) {
+    switch (placement) {
+        case Placement::SameL3:
+            return "same_l3";
+        case Placement::SmtSibling:
+            return "smt";
+        case Placement::CrossSocket:
+            return "cross_socket";
+        case Placement::Any:
+            return "any";
+    }
+    return "?";
+}
+
+inline std::optional<Placement> parsePlacement(const std::string& name) {
+    for (auto placement: {Placement::SameL3, Placement::SmtSibling, Placement::CrossSocket, Placement::Any}) {
+        if (name == placementName(placement)) return placement;
+    }
+    return std::nullopt;
+}
+
+// sysfs cpu list format: "0-3,8,10-11"
+inline std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    for (std::string item; std::getline(ss, item, ',');) {
+        if (item.empty() || !std::isdigit(static_cast<unsigned char>(item[0]))) continue;
+        const auto dash = item.find('-');
+        const int first = std::stoi(item.substr(0, dash));
+        const int last = dash == std::string::npos ? first : std::stoi(item.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+struct CpuInfo {
+    int cpu_;
+    int package_;   // socket
+    int die_;       // die within the socket
+    int core_;      // lowest cpu among the SMT siblings, unique per physical core
+    int l2_;        // lowest cpu sharing the L2, -1 if unknown
+    int l3_;        // lowest cpu sharing the L3, -1 if unknown
+    bool isolated_;
+};
+
+struct Topology {
+    std::vector<CpuInfo> cpus_;  // online cpus we are allowed to run on, in preference order
+
+    static std::string readLine(const std::string& path) {
+        std::ifstream file(path);
+        std::string line;
+        std::getline(file, line);
+        return line;
+    }
+
+    static int readInt(const std::string& path, int fallback) {
+        const auto line = readLine(path);
+        return line.empty() ? fallback : std::stoi(line);
+    }
+
+    // lowest cpu in a shared_cpu_list style file
+    static int firstCpu(const std::string& path, int fallback) {
+        const auto cpus = parseCpuList(readLine(path));
+        return cpus.empty() ? fallback : *std::min_element(cpus.begin(), cpus.end());
+    }
+
+    static Topology read() {
+        const std::string root = "/sys/devices/system/cpu/";
+        const auto isolated_list = parseCpuList(readLine(root + "isolated"));
+        const std::set<int> isolated(isolated_list.begin(), isolated_list.end());
+
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) CPU_SET(cpu, &allowed);
+        }
+
+        auto online = parseCpuList(readLine(root + "online"));
+        if (online.empty()) {
+            for (unsigned cpu = 0; cpu < std::thread::hardware_concurrency(); ++cpu) {
+                online.push_back(static_cast<int>(cpu));
+            }
+        }
+
+        Topology topo;
+        for (int cpu: online) {
+            if (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed)) continue;
+            const auto dir = root + "cpu" + std::to_string(cpu) + "/";
+            CpuInfo info{cpu, readInt(dir + "topology/physical_package_id", 0), readInt(dir + "topology/die_id", 0),
+                         firstCpu(dir + "topology/thread_siblings_list", cpu), -1, -1, isolated.count(cpu) > 0};
+            for (int index = 0;; ++index) {
+                const auto cache = dir + "cache/index" + std::to_string(index) + "/";
+                const auto level = readInt(cache + "level", -1);
+                if (level < 0) break;
+                if (readLine(cache + "type") == "Instruction") continue;
+                if (level == 2) info.l2_ = firstCpu(cache + "shared_cpu_list", -1);
+                if (level == 3) info.l3_ = firstCpu(cache + "shared_cpu_list", -1);
+            }
+            topo.cpus_.push_back(info);
+        }
+
+        // isolated cores first, the core of cpu 0 last, otherwise in cpu order
+        int housekeeping = -1;
+        for (auto& c: topo.cpus_) {
+            if (c.cpu_ == 0) housekeeping = c.core_;
+        }
+        std::stable_sort(topo.cpus_.begin(), topo.cpus_.end(), [housekeeping](const CpuInfo& a, const CpuInfo& b) {
+            auto rank = [housekeeping](const CpuInfo& c) { return c.isolated_ ? 0 : c.core_ == housekeeping ? 2 : 1; };
+            return rank(a) < rank(b);
+        });
+        return topo;
+    }
+
+    [[nodiscard]] std::size_t packages() const {
+        std::set<int> packages;
+        for (auto& c: cpus_) packages.insert(c.package_);
+        return packages.size();
+    }
+
+    // one cpu per physical core first, then the remaining siblings, in preference order
+    static std::vector<int> spreadCores(const std::vector<CpuInfo>& candidates, std::size_t n) {
+        std::vector<int> out;
+        std::set<int> used_cores;
+        for (auto& c: candidates) {
+            if (out.size() < n && used_cores.insert(c.core_).second) out.push_back(c.cpu_);
+        }
+        for (auto& c: candidates) {
+            if (out.size() < n && std::find(out.begin(), out.end(), c.cpu_) == out.end()) out.push_back(c.cpu_);
+        }
+        return out;
+    }
+
+    static std::size_t coreCount(const std::vector<CpuInfo>& candidates) {
+        std::set<int> cores;
+        for (auto& c: candidates) cores.insert(c.core_);
+        return cores.size();
+    }
+
+    // n cores for the policy, never fewer: cores are reused round-robin if the machine is too small
+    [[nodiscard]] std::vector<int> place(Placement placement, std::size_t n) const {
+        if (cpus_.empty()) return std::vector<int>(n, 0);
+        std::vector<int> out = placeStrict(placement, n);
+        if (out.empty()) {
+            const auto fallback = placement == Placement::SameL3 ? Placement::Any : Placement::SameL3;
+            std::cerr << "placement " << placementName(placement) << " not possible for " << n << " cpus, using "
+                      << placementName(fallback) << std::endl;
+            return place(fallback, n);
+        }
+        if (out.size() < n) {
+            std::cerr << "only " << out.size() << " cpus available for " << n << " roles, sharing cores" << std::endl;
+            for (std::size_t i = out.size(), m = out.size(); i < n; ++i) out.push_back(out[i % m]);
+        }
+        return out;
+    }
+
+    // empty if the policy can't be met
+    [[nodiscard]] std::vector<int> placeStrict(Placement placement, std::size_t n) const {
+        switch (placement) {
+            case Placement::SameL3: {
+                // the L3 domain offering the most physical cores, first one in preference order on ties
+                std::map<int, std::vector<CpuInfo>> domains;
+                std::vector<int> order;
+                for (auto& c: cpus_) {
+                    if (!domains.count(c.l3_)) order.push_back(c.l3_);
+                    domains[c.l3_].push_back(c);
+                }
+                const std::vector<CpuInfo>* best = nullptr;
+                for (int l3: order) {
+                    if (!best || coreCount(domains[l3]) > coreCount(*best)) best = &domains.at(l3);
+                }
+                if (!best || coreCount(*best) < n) return {};
+                return spreadCores(*best, n);
+            }
+            case Placement::SmtSibling: {
+                // whole physical cores, siblings of the same core next to each other
+                std::map<int, std::vector<int>> cores;
+                std::vector<int> order;
+                for (auto& c: cpus_) {
+                    if (!cores.count(c.core_)) order.push_back(c.core_);
+                    cores[c.core_].push_back(c.cpu_);
+                }
+                std::vector<int> out;
+                for (int core: order) {
+                    if (cores[core].size() < 2) continue;
+                    for (int cpu: cores[core]) {
+                        if (out.size() < n) out.push_back(cpu);
+                    }
+                }
+                return out.size() == n ? out : std::vector<int>{};
+            }
+            case Placement::CrossSocket: {
+                if (packages() < 2) return {};
+                std::map<int, std::vector<CpuInfo>> sockets;
+                for (auto& c: cpus_) sockets[c.package_].push_back(c);
+                std::vector<std::vector<int>> per_socket;
+                for (auto& [package, cpus]: sockets) per_socket.push_back(spreadCores(cpus, cpus.size()));
+                std::vector<int> out;
+                for (std::size_t i = 0; out.size() < n && i < n * per_socket.size(); ++i) {
+                    auto& cpus = per_socket[i % per_socket.size()];
+                    const auto k = i / per_socket.size();
+                    if (k < cpus.size()) out.push_back(cpus[k]);
+                }
+                return out;
+            }
+            case Placement::Any:
+                return spreadCores(cpus_, n);
+        }
+        return {};
+    }
+};
+
+// what two cpus share, from closest to farthest
+enum class CpuRelation {
+    Same,
+    SmtSibling,   // same physical core
+    SameL3,       // same L3 (CCX on AMD)
+    CrossL3,      // same die, different L3
+    CrossDie,     // same socket, different die
+    CrossSocket,
+};
+
+inline const char* relationName(CpuRelation relation) {
+    switch (relation) {
+        case CpuRelation::Same:
+            return "same";
+        case CpuRelation::SmtSibling:
+            return "smt_sibling";
+        case CpuRelation::SameL3:
+            return "same_l3";
+        case CpuRelation::CrossL3:
+            return "cross_l3";
+        case CpuRelation::CrossDie:
+            return "cross_die";
+        case CpuRelation::CrossSocket:
+            return "cross_socket";
+    }
+    return "?";
+}
+
+inline CpuRelation relation(const CpuInfo& a, const CpuInfo& b) {
+    if (a.cpu_ == b.cpu_) return CpuRelation::Same;
+    if (a.core_ == b.core_) return CpuRelation::SmtSibling;
+    if (a.package_ != b.package_) return CpuRelation::CrossSocket;
+    if (a.die_ != b.die_) return CpuRelation::CrossDie;
+    if (a.l3_ >= 0 && a.l3_ == b.l3_) return CpuRelation::SameL3;
+    return CpuRelation::CrossL3;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const CpuInfo& c) {
+    return os << "cpu " << c.cpu_ << " socket " << c.package_ << " die " << c.die_ << " core " << c.core_ << " l2 " << c.l2_ << " l3 "
+              << c.l3_ << (c.isolated_ ? " isolated" : "");
+}
+
+// read once, before anything pins itself, so that the affinity mask is the one we were started with
+inline const Topology& topology() {
+    static const Topology topo = Topology::read();
+    return topo;
+}
+
+// policy and explicit cores from IPC_PLACEMENT / IPC_CPUS
+inline std::vector<int> placeCpusFromEnv(std::size_t n) {
+    if (const char* list = std::getenv("IPC_CPUS")) {
+        auto cpus = parseCpuList(list);
+        if (!cpus.empty()) {
+            for (std::size_t i = cpus.size(), m = cpus.size(); i < n; ++i) cpus.push_back(cpus[i % m]);
+            cpus.resize(n);
+            return cpus;
+        }
+    }
+    auto placement = Placement::SameL3;
+    if (const char* name = std::getenv("IPC_PLACEMENT")) {
+        if (auto parsed = parsePlacement(name)) {
+            placement = *parsed;
+        } else {
+            std::cerr << "unknown IPC_PLACEMENT " << name << ", using " << placementName(placement) << std::endl;
+        }
+    }
+    return topology().place(placement, n);
+}
+
+// computed once per n, so that every role of a run sees the same placement (and warnings are printed once)
+inline std::vector<int> placeCpus(std::size_t n) {
+    static std::mutex mutex;
+    static std::map<std::size_t, std::vector<int>> placed;
+    std::lock_guard lock(mutex);
+    auto& cpus = placed[n];
+    if (cpus.empty()) cpus = placeCpusFromEnv(n);
+    return cpus;
+}
+
+inline int placeCpu(std::size_t role, std::size_t roles) {
+    return placeCpus(roles)[role];
+}
+
+// pins the calling thread to the core of its role
+inline bool pinRole(std::size_t role, std::size_t roles) {
+    return pinCpu(placeCpu(role, roles));
+}
+
+// for spinning roles: pins only if every role gets a cpu of its own, otherwise leaves it to the scheduler
+inline void pinRoleIfAvailable(std::size_t role, std::size_t roles) {
+    if (roles <= topology().cpus_.size() || std::getenv("IPC_CPUS")) {
+        pinRole(role, roles);
+    }
+}
+
+#endif //CONCURRENCY_TOPOLOGY_H
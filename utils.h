@@ -6,6 +6,7 @@
 #define CONCURRENCY_UTILS_H
 
 #include <bits/stdc++.h>
+#include <cpuid.h>
 #include <cstdint>
 #include <cstring>
 #include <fcntl.h>
@@ -32,6 +33,123 @@ inline unsigned long long rdtscp() {
     return __builtin_ia32_rdtscp(&dummy);
 }
 
+/**
+ * TSC calibration
+ * - ns_per_cycle: measured against steady_clock, only meaningful if the TSC is invariant (constant rate in all
+ *   P-/C-states, synchronized across cores), which is what we check with cpuid
+ * - rdtscp_overhead: minimum cost of back-to-back rdtscp, subtract it from latencies measured between two rdtscp
+ * Calibrated once, on first use.
+ */
+struct TscCalibration {
+    double ns_per_cycle;
+    std::uint64_t rdtscp_overhead;
+    bool invariant;
+};
+
+inline TscCalibration calibrateTsc() {
+    TscCalibration c{};
+    unsigned eax, ebx, ecx, edx;
+    c.invariant = __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u << 8));
+    if (!c.invariant) {
+        std::cerr << "TSC is not invariant, ns conversions are unreliable" << std::endl;
+    }
+
+    c.rdtscp_overhead = std::numeric_limits<std::uint64_t>::max();
+    for (int i = 0; i < 10'000; ++i) {
+        auto t1 = rdtscp();
+        auto t2 = rdtscp();
+        c.rdtscp_overhead = std::min<std::uint64_t>(c.rdtscp_overhead, t2 - t1);
+    }
+
+    // busy wait rather than sleep, so that we don't calibrate across a migration
+    const auto t0 = std::chrono::steady_clock::now();
+    const auto c0 = rdtscp();
+    auto t1 = t0;
+    while (t1 - t0 < std::chrono::milliseconds(50)) {
+        t1 = std::chrono::steady_clock::now();
+    }
+    const auto c1 = rdtscp();
+    c.ns_per_cycle = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count())
+                     / static_cast<double>(c1 - c0);
+    return c;
+}
+
+inline const TscCalibration& tscCalibration() {
+    static const TscCalibration calibration = calibrateTsc();
+    return calibration;
+}
+
+inline double cyclesToNs(std::uint64_t cycles) {
+    return static_cast<double>(cycles) * tscCalibration().ns_per_cycle;
+}
+
+/**
+ * HDR-style latency histogram with fixed memory, record() never allocates
+ * - values below 256 get their own bucket
+ * - above that, every power of 2 is split into 128 linear sub-buckets: relative error < 1%
+ * Values are recorded in whatever unit the caller uses (usually cycles), print() converts them.
+ */
+struct LatencyHistogram {
+    static constexpr std::uint32_t SUB_BITS = 7;
+    static constexpr std::uint64_t SUB = 1ull << SUB_BITS;
+    static constexpr std::size_t BUCKETS = (64 - SUB_BITS) * SUB + SUB;
+
+    std::array<std::uint64_t, BUCKETS> counts_{};
+    std::uint64_t total_{0};
+    std::uint64_t max_{0};
+
+    static std::size_t index(std::uint64_t v) {
+        if (v < 2 * SUB) return v;
+        const std::uint32_t e = 63 - __builtin_clzll(v) - SUB_BITS;
+        return e * SUB + (v >> e);
+    }
+
+    // highest value that falls in the bucket
+    static std::uint64_t upperBound(std::size_t idx) {
+        if (idx < 2 * SUB) return idx;
+        const std::uint64_t e = idx / SUB - 1;
+        const std::uint64_t sub = idx - e * SUB;
+        return ((sub + 1) << e) - 1;
+    }
+
+    void record(std::uint64_t v) {
+        ++counts_[index(v)];
+        ++total_;
+        max_ = std::max(max_, v);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (std::size_t i = 0; i < BUCKETS; ++i) counts_[i] += other.counts_[i];
+        total_ += other.total_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    void reset() {
+        counts_.fill(0);
+        total_ = 0;
+        max_ = 0;
+    }
+
+    [[nodiscard]] std::uint64_t percentile(double q) const {
+        if (!total_) return 0;
+        const auto rank = static_cast<std::uint64_t>(std::ceil(q * static_cast<double>(total_)));
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < BUCKETS; ++i) {
+            seen += counts_[i];
+            if (seen >= rank && counts_[i]) return std::min(upperBound(i), max_);
+        }
+        return max_;
+    }
+
+    // one line: count, p50, p99, p99.9, p99.99 and max, multiplied by unit_ns (cyclesToNs factor by default)
+    void print(std::ostream& os, const char* name, double unit_ns = tscCalibration().ns_per_cycle) const {
+        auto ns = [unit_ns](std::uint64_t v) { return static_cast<std::uint64_t>(static_cast<double>(v) * unit_ns); };
+        os << name << " count: " << total_ << " p50: " << ns(percentile(0.5)) << " p99: " << ns(percentile(0.99))
+           << " p99.9: " << ns(percentile(0.999)) << " p99.99: " << ns(percentile(0.9999)) << " max: " << ns(max_)
+           << " ns" << std::endl;
+    }
+};
+
 /**
  * CPU pinning: to avoid context switching
  */
@@ -75,4 +193,110 @@ T* shmMap(const char* filename) {
     return ptr;
 }
 
+/**
+ * Shared memory mapping options, all of them are best effort, check ShmReport for what actually took effect
+ * - huge_pages: back the segment by a file in a hugetlbfs mount (2MB pages, fewer TLB misses for big rings),
+ *   falls back to shm_open + madvise(MADV_HUGEPAGE), which only helps if shmem THP is enabled
+ * - populate: fault every page in at map time (MAP_POPULATE / MADV_POPULATE_WRITE) instead of on the hot path
+ * - lock: mlock the pages so that they are never swapped out (needs RLIMIT_MEMLOCK or CAP_IPC_LOCK)
+ * Every process mapping the same segment must use the same huge_pages setting and hugetlbfs_dir.
+ */
+struct ShmOptions {
+    bool huge_pages = false;
+    bool populate = false;
+    bool lock = false;
+    const char* hugetlbfs_dir = "/dev/hugepages";
+};
+
+struct ShmReport {
+    bool hugetlbfs = false;
+    bool thp_advised = false;
+    bool populated = false;
+    bool locked = false;
+    std::size_t mapped_size = 0;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const ShmReport& report) {
+    return os << "mapped_size: " << report.mapped_size << " hugetlbfs: " << report.hugetlbfs
+              << " thp_advised: " << report.thp_advised << " populated: " << report.populated
+              << " locked: " << report.locked;
+}
+
+template<typename T>
+T* shmMap(const char* filename, const ShmOptions& options, ShmReport* report = nullptr) {
+    ShmReport local_report;
+    ShmReport& r = report ? *report : local_report;
+    r = ShmReport{};
+
+    const int populate_flag = options.populate ? MAP_POPULATE : 0;
+    void* ptr = MAP_FAILED;
+    std::size_t size = sizeof(T);
+
+    if (options.huge_pages) {
+        // 1. hugetlbfs: the size has to be a multiple of the huge page size
+        const std::string path = std::string(options.hugetlbfs_dir) + "/" + filename;
+        const std::size_t huge_size = (sizeof(T) + (2ul << 20) - 1) & ~((2ul << 20) - 1);
+        // only the process that created the file may remove it, and only that one may fall back to /dev/shm:
+        // once a hugetlbfs file exists, another process may be using it
+        int fd = open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+        const bool created = fd != -1;
+        if (!created && errno == EEXIST) {
+            fd = open(path.c_str(), O_RDWR);
+        }
+        if (fd != -1) {
+            struct stat st{};
+            if (created ? ftruncate(fd, static_cast<off_t>(huge_size)) == 0
+                        : fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= huge_size) {
+                ptr = mmap(nullptr, huge_size, PROT_READ | PROT_WRITE, MAP_SHARED | populate_flag, fd, 0);
+            }
+            close(fd);
+            if (ptr != MAP_FAILED) {
+                size = huge_size;
+                r.hugetlbfs = true;
+            } else if (created) {
+                unlink(path.c_str());
+            } else {
+                std::cerr << "Failed to map existing hugetlbfs file " << path << std::endl;
+                return nullptr;
+            }
+        }
+    }
+
+    if (ptr == MAP_FAILED) {
+        int shm_fd = shm_open(filename, O_CREAT | O_RDWR, 0666);
+        if (shm_fd == -1) {
+            std::cerr << "Failed to open shared memory" << strerror(errno) << std::endl;
+            return nullptr;
+        }
+        if (ftruncate(shm_fd, sizeof(T))) {
+            std::cerr << "Failed to truncate shared memory" << strerror(errno) << std::endl;
+            close(shm_fd);
+            return nullptr;
+        }
+        ptr = mmap(nullptr, sizeof(T), PROT_READ | PROT_WRITE, MAP_SHARED | populate_flag, shm_fd, 0);
+        close(shm_fd);
+        if (ptr == MAP_FAILED) {
+            std::cerr << "Failed to map shared memory" << strerror(errno) << std::endl;
+            return nullptr;
+        }
+        // 2. fallback: transparent huge pages for shmem, if the kernel allows it
+        if (options.huge_pages) {
+            r.thp_advised = madvise(ptr, size, MADV_HUGEPAGE) == 0;
+        }
+    }
+    r.mapped_size = size;
+
+    if (options.populate) {
+        // MAP_POPULATE is best effort and reports nothing, MADV_POPULATE_WRITE (linux 5.14) does
+        // unlike touching the pages ourselves, neither modifies the content of an existing segment
+#ifdef MADV_POPULATE_WRITE
+        r.populated = madvise(ptr, size, MADV_POPULATE_WRITE) == 0;
+#endif
+    }
+    if (options.lock) {
+        r.locked = mlock(ptr, size) == 0;
+    }
+    return static_cast<T*>(ptr);
+}
+
 #endif //CONCURRENCY_UTILS_H
@@ -0,0 +1,127 @@
+#include "spsc.h"
+#include "spmc.h"
+#include "topology.h"
+
+#include <thread>
+#include <vector>
+
+/**
+ * Latency and CPU cost of each wait strategy for a low-rate channel
+ * the producer sends one message every gap, consumers report their latency percentiles in ns (LatencyHistogram)
+ * and how much of a core they burned (thread cpu time / wall time)
+ */
+
+struct Msg {
+    uint64_t ts_;
+    uint64_t idx_;
+};
+
+const uint64_t loop = 10'000;
+const auto gap = std::chrono::microseconds(100);
+
+uint64_t threadCpuNs() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1'000'000'000ull + ts.tv_nsec;
+}
+
+void report(const char* name, const LatencyHistogram& lat, uint64_t cpu_ns, std::chrono::steady_clock::duration wall) {
+    const auto wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wall).count();
+    std::ostringstream os;
+    os << name << " cpu: " << (100.0 * static_cast<double>(cpu_ns) / static_cast<double>(wall_ns)) << "% ";
+    lat.print(os, "latency");
+    std::cout << os.str() << std::flush;
+}
+
+template<typename Wait>
+void spscRun(const char* name) {
+    auto* queue = new SPSCQueue<Msg, 1024, Wait>();
+
+    std::jthread recv([queue, name] {
+        if (!pinRole(1, 2)) {
+            exit(1);
+        }
+        LatencyHistogram lat;
+        const auto start = std::chrono::steady_clock::now();
+        const auto cpu_start = threadCpuNs();
+        for (uint64_t i = 0; i < loop; ++i) {
+            Msg* msg = queue->waitFront();
+            lat.record(rdtscp() - msg->ts_);
+            queue->pop();
+        }
+        report(name, lat, threadCpuNs() - cpu_start, std::chrono::steady_clock::now() - start);
+    });
+
+    std::jthread send([queue] {
+        if (!pinRole(0, 2)) {
+            exit(1);
+        }
+        for (uint64_t i = 0; i < loop; ++i) {
+            queue->blockPush([i](Msg* msg) {
+                msg->idx_ = i;
+                msg->ts_ = rdtscp();
+            });
+            std::this_thread::sleep_for(gap);
+        }
+    });
+
+    send.join();
+    recv.join();
+    delete queue;
+}
+
+template<typename Wait>
+void spmcRun(const char* name, int readers) {
+    auto* queue = new SPMCQueue<Msg, 1024, Wait>();
+    std::latch latch(readers + 1);
+
+    std::vector<std::jthread> threads;
+    for (int r = 0; r < readers; ++r) {
+        threads.emplace_back([queue, name, r, readers, &latch] {
+            if (!pinRole(r + 1, readers + 1)) {
+                exit(1);
+            }
+            auto reader = queue->getReader();
+            latch.arrive_and_wait();
+            LatencyHistogram lat;
+            const auto start = std::chrono::steady_clock::now();
+            const auto cpu_start = threadCpuNs();
+            while (true) {
+                Msg* msg = reader.waitRead();
+                lat.record(rdtscp() - msg->ts_);
+                if (msg->idx_ == loop - 1) break;
+            }
+            report(name, lat, threadCpuNs() - cpu_start, std::chrono::steady_clock::now() - start);
+        });
+    }
+
+    if (!pinRole(0, readers + 1)) {
+        exit(1);
+    }
+    latch.arrive_and_wait();
+    for (uint64_t i = 0; i < loop; ++i) {
+        queue->write([i](Msg& msg) {
+            msg.idx_ = i;
+            msg.ts_ = rdtscp();
+        });
+        std::this_thread::sleep_for(gap);
+    }
+    threads.clear();
+    delete queue;
+}
+
+int main() {
+    tscCalibration();  // calibrate before the threads start
+    std::cout << "SPSCQueue, one message every " << gap.count() << "us\n";
+    spscRun<BusySpinWait>("busy_spin ");
+    spscRun<PauseSpinWait>("pause_spin");
+    spscRun<FutexWait<>>("futex     ");
+    spscRun<EventFdWait<>>("eventfd   ");
+
+    std::cout << "SPMCQueue with 2 readers, one message every " << gap.count() << "us\n";
+    spmcRun<BusySpinWait>("busy_spin ", 2);
+    spmcRun<PauseSpinWait>("pause_spin", 2);
+    spmcRun<FutexWait<>>("futex     ", 2);
+
+    return 0;
+}
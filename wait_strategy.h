@@ -0,0 +1,161 @@
+#ifndef CONCURRENCY_WAIT_STRATEGY_H
+#define CONCURRENCY_WAIT_STRATEGY_H
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <linux/futex.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * Wait strategies for queue consumers
+ * - wait(ready): called by a consumer, returns once ready() is true
+ * - notify(): called by the producer right after publishing, must be cheap when nobody is parked
+ *
+ * BusySpinWait: lowest latency, burns a whole core
+ * PauseSpinWait: same, but with pause to be nicer to the SMT sibling and to save some power
+ * FutexWait: spin SpinCnt times, then sleep on a futex word that lives in the queue (works across processes)
+ * EventFdWait: spin SpinCnt times, then block on an eventfd, fd() can be registered into epoll (single consumer only)
+ *
+ * Parking protocol (FutexWait and EventFdWait):
+ * consumer: ++waiters_, fence, re-check ready(), sleep
+ * producer: publish, fence, only if waiters_ != 0 make the wake syscall
+ * the two fences guarantee that either the consumer sees the new message or the producer sees the waiter
+ */
+
+inline void cpuRelax() {
+    __builtin_ia32_pause();
+}
+
+struct BusySpinWait {
+    static constexpr bool multi_consumer = true;
+
+    template<typename Ready>
+    void wait(Ready ready) {
+        while (!ready()) {}
+    }
+
+    void notify() {}
+};
+
+struct PauseSpinWait {
+    static constexpr bool multi_consumer = true;
+
+    template<typename Ready>
+    void wait(Ready ready) {
+        while (!ready()) {
+            cpuRelax();
+        }
+    }
+
+    void notify() {}
+};
+
+template<std::uint32_t SpinCnt = 4096>
+struct FutexWait {
+    static constexpr bool multi_consumer = true;
+
+    // seq_ and waiters_ share a cache line away from the queue's indices: a consumer parks touching both, and the
+    // producer only reads waiters_ while nobody is parked
+    alignas(64) std::atomic<std::uint32_t> seq_{0};
+    std::atomic<std::uint32_t> waiters_{0};
+
+    template<typename Ready>
+    void wait(Ready ready) {
+        for (std::uint32_t i = 0; i < SpinCnt; ++i) {
+            if (ready()) return;
+            cpuRelax();
+        }
+        while (!ready()) {
+            waiters_.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto seq = seq_.load(std::memory_order_acquire);
+            if (!ready()) {
+                // not FUTEX_WAIT_PRIVATE: the word may be shared between processes through shmMap
+                syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&seq_), FUTEX_WAIT, seq, nullptr, nullptr, 0);
+            }
+            waiters_.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (__builtin_expect(waiters_.load(std::memory_order_relaxed) != 0, 0)) {
+            seq_.fetch_add(1, std::memory_order_release);
+            syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&seq_), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+        }
+    }
+};
+
+/**
+ * The eventfd is created by the constructor, so the queue must be constructed in the process that uses it
+ * (a global, new, or inherited by fork), a zero-filled shmMap segment does not own a valid fd.
+ * For epoll: register fd() for EPOLLIN, call arm(ready) before epoll_wait (skip the wait if it returns false),
+ * and disarm() after waking up.
+ * The consumer drains the eventfd when it wakes up, with several consumers on one fd a consumer may go back to sleep
+ * after another one drained it, so it is single consumer only: one queue (or lane) per eventfd.
+ */
+template<std::uint32_t SpinCnt = 4096>
+struct EventFdWait {
+    static constexpr bool multi_consumer = false;
+
+    alignas(64) int fd_{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)};
+    std::atomic<std::uint32_t> waiters_{0};
+
+    EventFdWait() = default;
+    EventFdWait(const EventFdWait&) = delete;
+    EventFdWait& operator=(const EventFdWait&) = delete;
+
+    ~EventFdWait() {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    [[nodiscard]] int fd() const { return fd_; }
+
+    // returns true if the caller may block on fd(), false if ready() already holds
+    template<typename Ready>
+    bool arm(Ready ready) {
+        waiters_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ready()) {
+            disarm();
+            return false;
+        }
+        return true;
+    }
+
+    void disarm() {
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+        std::uint64_t cnt;
+        // drain, it may already be empty (EAGAIN) if nothing was written while armed
+        [[maybe_unused]] auto ret = read(fd_, &cnt, sizeof(cnt));
+    }
+
+    template<typename Ready>
+    void wait(Ready ready) {
+        for (std::uint32_t i = 0; i < SpinCnt; ++i) {
+            if (ready()) return;
+            cpuRelax();
+        }
+        while (!ready()) {
+            if (arm(ready)) {
+                pollfd pfd{fd_, POLLIN, 0};
+                poll(&pfd, 1, -1);
+                disarm();
+            }
+        }
+    }
+
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (__builtin_expect(waiters_.load(std::memory_order_relaxed) != 0, 0)) {
+            std::uint64_t one = 1;
+            [[maybe_unused]] auto ret = write(fd_, &one, sizeof(one));
+        }
+    }
+};
+
+#endif //CONCURRENCY_WAIT_STRATEGY_H
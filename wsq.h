@@ -0,0 +1,263 @@
+#ifndef CONCURRENCY_WSQ_H
+#define CONCURRENCY_WSQ_H
+
+#include "telemetry.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <vector>
+
+/**
+ * Work stealing queue: a queue that allows
+ * - one thread to push/pop items into/from one end of the queue
+ * - multiple threads to steal items from the other end
+ * Unlike a regular SPMC:
+ * - Owner: FIFO (owner produces and consumes fresh jobs)
+ * - Thief: LIFO (thief consumes stale jobs)
+ * Idea: To better utilize cache:
+ * keep the local cache warm on each thread,
+ * each thread trying to only work on jobs recently produced prior jobs on the same thread.
+ * Other thief threads may take stale jobs from other threads that are probably cold in cache
+ *
+ * This is a direct implementation from this paper: Correct and Efficient Work-Stealing for Weak Memory Models
+ * Nhat Minh Le, Antoniu Pop, Albert Cohen, Francesco Zappa Nardelli
+ * INRIA and ENS Paris
+ *
+ * Reclamation of retired arrays (after a grow or a shrink), epoch based with two counters:
+ * - a thief announces itself in active_[epoch & 1] (re-checking that epoch is still current) before loading array_,
+ *   and leaves once it copied the item out
+ * - only the owner retires arrays and advances the epoch, from e to e + 1 only once the thieves of e - 1 are gone
+ * - an array retired during epoch r can be freed once the epoch is past r + 1 and the thieves of r are gone
+ * So memory goes back after a burst instead of living until the destructor.
+ * Optional shrink: with shrink_after > 0, the owner halves the array (never below the initial capacity)
+ * after shrink_after consecutive pushes that found it less than a quarter full.
+ */
+
+template<typename T>
+struct WorkStealingQueue {
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+
+    struct Array {
+        using allocator_type = std::pmr::polymorphic_allocator<>;
+
+        const std::size_t capacity_;
+        const std::size_t modulo_;
+        std::atomic<T>* S_;
+        allocator_type allocator_;
+
+        Array(std::size_t cap, allocator_type alloc = {}) : capacity_{cap}, modulo_{cap - 1},
+                                                            S_{alloc.allocate_object<std::atomic<T>>(cap)},
+                                                            allocator_(alloc) {
+        }
+
+        ~Array() {
+            allocator_.deallocate_object(S_, capacity_);
+        }
+
+        template<typename Obj>
+        void push(uint64_t idx, Obj&& obj) noexcept {
+            S_[idx & modulo_].store(std::forward<Obj>(obj), std::memory_order_relaxed);
+        }
+
+        // removes and retrieves
+        T pop(uint64_t idx) noexcept {
+            return S_[idx & modulo_].load(std::memory_order_relaxed);
+        }
+
+        // expensive operation
+        Array* resize(uint64_t bottom, uint64_t top, std::size_t capacity) {
+            Array* ptr = allocator_.new_object<Array>(capacity);
+            for (uint64_t i = top; i != bottom; ++i) {
+                ptr->push(i, this->pop(i));
+            }
+            return ptr;
+        }
+    };
+
+
+    // to avoid false sharing, put atomic variables on different cache lines
+#ifdef __cpp_lib_hardware_interference_size
+    alignas(std::hardware_destructive_interference_size) std::atomic<uint64_t> top_;
+    alignas(std::hardware_destructive_interference_size) std::atomic<uint64_t> bottom_;
+#else
+    alignas(64) std::atomic<uint64_t> top_;
+    alignas(64) std::atomic<uint64_t> bottom_;
+#endif
+    std::atomic<Array*> array_;
+
+    // written by thieves on every steal, keep them away from top_/bottom_
+    alignas(64) std::atomic<uint64_t> epoch_{0};
+    std::atomic<uint64_t> active_[2]{};
+
+    // owner only
+    struct Retired {
+        Array* array_;
+        uint64_t epoch_;
+    };
+    alignas(64) std::pmr::vector<Retired> garbage_;
+    const std::size_t min_capacity_;
+    const uint64_t shrink_after_;
+    uint64_t low_cnt_{0};
+    [[no_unique_address]] QueueTelemetry telemetry_;  // empty unless built with QUEUE_TELEMETRY
+
+    explicit WorkStealingQueue(uint64_t capacity, allocator_type alloc = {}, uint64_t shrink_after = 0)
+            : garbage_(alloc), min_capacity_(capacity), shrink_after_(shrink_after) {
+        // only powers of 2 accepted for capacity
+        assert(capacity && (!(capacity & (capacity - 1))));
+        top_.store(0, std::memory_order_relaxed);
+        bottom_.store(0, std::memory_order_relaxed);
+        array_.store(alloc.new_object<Array>(capacity), std::memory_order_relaxed);
+        garbage_.reserve(32);
+    }
+
+    ~WorkStealingQueue() {
+        for (auto& r: garbage_) {
+            garbage_.get_allocator().delete_object(r.array_);
+        }
+        // not actually atomic load, just a regular load is needed
+        garbage_.get_allocator().delete_object(array_.load());
+    }
+
+    template<typename Obj>
+    void push(Obj&& obj) {
+        auto b = bottom_.load(std::memory_order_relaxed);
+        // acquire here is important, we need updated b and t at this point
+        auto t = top_.load(std::memory_order_acquire);
+
+        /* [[start of "critical section"]] */
+        auto* a = array_.load(std::memory_order_relaxed);
+
+        // queue is full
+        if (a->capacity_ - 1 < b - t) {
+            a = replace(a, b, t, a->capacity_ * 2);
+        } else if (shrink_after_ && a->capacity_ > min_capacity_) {
+            low_cnt_ = b - t < a->capacity_ / 4 ? low_cnt_ + 1 : 0;
+            if (__builtin_expect(low_cnt_ >= shrink_after_, 0)) {
+                a = replace(a, b, t, a->capacity_ / 2);
+            }
+        }
+        if (__builtin_expect(!garbage_.empty(), 0)) {
+            collect();
+        }
+
+        a->push(b, std::forward<Obj>(obj));
+        /* [[end of "critical section"]] */
+        std::atomic_thread_fence(std::memory_order_release); // release to all threads
+        bottom_.store(b + 1, std::memory_order_relaxed);
+        telemetry_.onPush(b + 1 - t);
+    }
+
+    bool attachTelemetry(const char* name) { return telemetry_.attach(name, TelemetryKind::WSQ); }
+
+    std::optional<T> steal() {
+        auto t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto b = bottom_.load(std::memory_order_acquire);
+        std::optional<T> item;
+        // signed: the owner's pop() may have moved bottom one below top
+        if (static_cast<int64_t>(t) < static_cast<int64_t>(b)) {
+            // seq_cst with the owner's array_ store and epoch/active_ accesses, see collect()
+            auto e = epoch_.load(std::memory_order_seq_cst);
+            while (true) {
+                active_[e & 1].fetch_add(1, std::memory_order_seq_cst);
+                const auto now = epoch_.load(std::memory_order_seq_cst);
+                if (now == e) break;
+                // the owner moved on meanwhile, only ever be counted under the current epoch
+                active_[e & 1].fetch_sub(1, std::memory_order_relaxed);
+                e = now;
+            }
+            auto& active = active_[e & 1];
+            auto* a = array_.load(std::memory_order_seq_cst);
+            item = a->pop(t);
+            active.fetch_sub(1, std::memory_order_release);
+            if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                telemetry_.onSteal(false);
+                return std::nullopt;
+            }
+            telemetry_.onSteal(true);
+        }
+
+        return item;
+    }
+
+    std::optional<T> pop() {
+        auto b = bottom_.load(std::memory_order_relaxed) - 1;
+        auto* a = array_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        // this generates a full barrier
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        auto t = top_.load(std::memory_order_relaxed);
+        std::optional<T> item;
+        // signed: b is top - 1 when the queue is empty, which wraps around at 0
+        if (static_cast<int64_t>(t) <= static_cast<int64_t>(b)) {
+            item = a->pop(b);
+            if (t == b) {
+                // last item just got stolen
+                if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    item = std::nullopt;
+                }
+                bottom_.store(b + 1, std::memory_order_relaxed);
+            }
+        } else {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        if (item) {
+            telemetry_.onPop();
+        } else {
+            telemetry_.onEmpty();
+        }
+        return item;
+    }
+
+
+    // owner only: copy [top, bottom) into a new array of the given capacity and retire the old one
+    Array* replace(Array* a, uint64_t b, uint64_t t, std::size_t capacity) {
+        auto* tmp = a->resize(b, t, capacity);
+        array_.store(tmp, std::memory_order_seq_cst);
+        garbage_.push_back({a, epoch_.load(std::memory_order_relaxed)});
+        low_cnt_ = 0;
+        telemetry_.onResize();
+        return tmp;
+    }
+
+    /**
+     * Owner only. A thief is counted in active_[e & 1] only while epoch e is current or just past, since we never
+     * advance while the previous epoch still has thieves. If the previous epoch has none, the only thieves left
+     * joined during the current epoch e and loaded array_ after it started, so arrays retired before e are free.
+     */
+    void collect() {
+        const auto e = epoch_.load(std::memory_order_relaxed);
+        if (active_[(e + 1) & 1].load(std::memory_order_seq_cst) != 0) {
+            return;
+        }
+        // thieves of e - 1 are gone: arrays retired before epoch e are safe to free
+        std::erase_if(garbage_, [this, e](const Retired& r) {
+            if (r.epoch_ + 1 > e) return false;
+            garbage_.get_allocator().delete_object(r.array_);
+            return true;
+        });
+        epoch_.store(e + 1, std::memory_order_seq_cst);
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        auto b = bottom_.load(std::memory_order_relaxed);
+        auto t = top_.load(std::memory_order_relaxed);
+        return static_cast<int64_t>(b) <= static_cast<int64_t>(t);
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept {
+        auto b = bottom_.load(std::memory_order_relaxed);
+        auto t = top_.load(std::memory_order_relaxed);
+        return static_cast<int64_t>(b) >= static_cast<int64_t>(t) ? b - t : 0;
+    }
+
+    [[nodiscard]] std::size_t capacity() const noexcept {
+        return array_.load(std::memory_order_relaxed)->capacity_;
+    }
+};
+
+#endif //CONCURRENCY_WSQ_H